@@ -0,0 +1,197 @@
+// Heap allocations from a new target to an output that has applied it,
+// counted by replacing `operator new` for the whole test binary.  Once warmed
+// up, a set and the wait for it to land should allocate nothing, so this
+// exits non-zero if it sees any: the daemon runs for months and takes key
+// repeat floods.
+//
+// Targets go through a real `Output`'s thread to real controls, minus Wayland
+// and D-Bus, whose events and signals allocate in libwayland, sdbus-c++ and
+// libsystemd whatever we do.
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_format.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <absl/types/span.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "brightness.h"
+#include "control-ddc-i2c.h"
+#include "control.h"
+#include "ddc-emulator.h"
+#include "ddc-pacer.h"
+#include "edid-cache.h"
+#include "lockstep.h"
+#include "output.h"
+#include "prober.h"
+#include "state.h"
+#include "sysfs-fixture.h"
+#include "waker.h"
+
+namespace {
+std::atomic<bool> counting = false;
+std::atomic<uint64_t> allocations = 0;
+
+void *Allocate(size_t size, size_t alignment) {
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  size = std::max<size_t>(size, 1);
+  // `aligned_alloc` wants a whole number of `alignment`s.
+  if (void *const p =
+          alignment <= alignof(std::max_align_t)
+              ? malloc(size)
+              : aligned_alloc(alignment,
+                              (size + alignment - 1) / alignment * alignment))
+    return p;
+  throw std::bad_alloc();
+}
+}  // namespace
+
+// The nothrow forms call these, so they're counted too.
+void *operator new(size_t size) { return Allocate(size, 0); }
+void *operator new[](size_t size) { return Allocate(size, 0); }
+void *operator new(size_t size, std::align_val_t alignment) {
+  return Allocate(size, static_cast<size_t>(alignment));
+}
+void *operator new[](size_t size, std::align_val_t alignment) {
+  return Allocate(size, static_cast<size_t>(alignment));
+}
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept {
+  free(p);
+}
+
+namespace jjaro {
+namespace {
+// Sets before counting starts, for buffers that grow once and stay.
+constexpr int kWarmUpCycles = 16;
+constexpr int kCycles = 500;
+// Far longer than any one set takes, so a control that stops applying levels
+// fails the test rather than hanging it.
+constexpr absl::Duration kSetTimeout = absl::Seconds(10);
+
+// Sets a new percentage and waits for an output following it through
+// `control` to apply it, over and over, and returns how many allocations
+// `kCycles` of that took once warmed up.
+absl::StatusOr<uint64_t> CountSetAndWait(std::unique_ptr<Control> control) {
+  State state;
+  {
+    StateUpdate u(&state);
+    state.desired_level = LevelFromPercent(0);
+    u.Changed();
+  }
+  Prober prober(ProbeContext{});
+  Lockstep lockstep;
+  const Control *const applying = control.get();
+  std::atomic<int> applied = -1;
+  Waker done;
+  // Once the output's thread is running, it's the only one that calls this,
+  // and so the only one to touch `applying`.
+  Output output(
+      &state, &prober, &lockstep, /*enumerator=*/nullptr, /*name=*/0,
+      /*version=*/0, absl::ZeroDuration(),
+      [&](absl::Span<const char *const>) {
+        const auto level = applying->cached_brightness_level();
+        applied.store(level.ok() ? *level : -1, std::memory_order_release);
+        done.Wake();
+      },
+      [](absl::string_view, int) {});
+  output.Install("DP-1", std::move(control));
+  int percent = 0;
+  const auto cycle = [&] {
+    percent = (percent + 1) % 101;
+    const int level = LevelFromPercent(percent);
+    {
+      StateUpdate u(&state);
+      state.desired_level = level;
+      u.TargetChanged();
+    }
+    const absl::Time deadline = absl::Now() + kSetTimeout;
+    while (true) {
+      const uint32_t seq = done.seq();
+      if (applied.load(std::memory_order_acquire) == level) return true;
+      if (!done.WaitUntil(seq, deadline)) return false;
+    }
+  };
+  for (int i = 0; i < kWarmUpCycles; ++i)
+    if (!cycle())
+      return absl::DeadlineExceededError("the output never applied a level");
+  allocations.store(0, std::memory_order_relaxed);
+  counting.store(true, std::memory_order_relaxed);
+  bool ok = true;
+  for (int i = 0; i < kCycles && ok; ++i) ok = cycle();
+  counting.store(false, std::memory_order_relaxed);
+  if (!ok)
+    return absl::DeadlineExceededError("the output stopped applying levels");
+  return allocations.load(std::memory_order_relaxed);
+}
+
+// Reports how `control`, or the failure to make it, fared; returns false if
+// it allocated or failed.
+bool Check(absl::string_view what,
+           absl::StatusOr<std::unique_ptr<Control>> control) {
+  if (!control.ok()) {
+    absl::FPrintF(stderr, "%s: %s\n", what, control.status().ToString());
+    return false;
+  }
+  const auto allocated = CountSetAndWait(*std::move(control));
+  if (!allocated.ok()) {
+    absl::FPrintF(stderr, "%s: %s\n", what, allocated.status().ToString());
+    return false;
+  }
+  if (*allocated) {
+    absl::FPrintF(stderr, "%s: %d allocations in %d sets\n", what, *allocated,
+                  kCycles);
+    return false;
+  }
+  absl::PrintF("%s: no allocations in %d sets\n", what, kCycles);
+  return true;
+}
+
+int Run() {
+  bool ok = true;
+  auto sysfs = SyntheticSysfs::Create({.backlights = 1});
+  if (!sysfs.ok()) {
+    absl::FPrintF(stderr, "backlight: %s\n", sysfs.status().ToString());
+    ok = false;
+  } else {
+    EDIDCache edid_cache;
+    ok &= Check("backlight",
+                Control::Probe(sysfs->outputs()[0],
+                               {.root = sysfs->root(),
+                                .edid_cache = &edid_cache}));
+  }
+  // Every write is read back, so Get VCP is covered too.  The bus is named
+  // as real ones are, since a name short enough to fit in a string without
+  // allocating could hide text built from it.
+  EmulatedDDCMonitor monitor("", {.reply_latency = absl::ZeroDuration()});
+  auto ddc = I2CDDCControl::Create(
+      "i2c-12", monitor.Connect(), /*verify_every=*/1,
+      std::make_shared<DDCPacer>(absl::ZeroDuration()));
+  if (ddc.ok()) {
+    ok &= Check("DDC/CI", std::make_unique<I2CDDCControl>(*std::move(ddc)));
+  } else {
+    ok &= Check("DDC/CI", ddc.status());
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+}  // namespace
+}  // namespace jjaro
+
+int main() { return jjaro::Run(); }
@@ -0,0 +1,32 @@
+#ifndef JJARO_BRIGHTNESS_H_
+#define JJARO_BRIGHTNESS_H_ 1
+
+#include <cstdint>
+
+// Brightness is carried as a level from 0 to `kMaxBrightnessLevel`, in
+// hundredths of a percent, so that panels with thousands of raw steps can
+// fade through them.  Each control maps levels onto its own raw range.
+namespace jjaro {
+constexpr int kMaxBrightnessLevel = 10000;
+constexpr int kBrightnessLevelsPerPercent = kMaxBrightnessLevel / 100;
+
+constexpr int LevelFromPercent(int64_t percent) {
+  return percent * kBrightnessLevelsPerPercent;
+}
+// Rounded to the nearest percent.
+constexpr int PercentFromLevel(int level) {
+  return (level + kBrightnessLevelsPerPercent / 2) /
+         kBrightnessLevelsPerPercent;
+}
+// These round to nearest too, so a raw value read back maps to the level
+// that wrote it, and a level maps to the closest raw value there is.
+constexpr int RawFromLevel(int level, int max_raw) {
+  return (int64_t{level} * max_raw + kMaxBrightnessLevel / 2) /
+         kMaxBrightnessLevel;
+}
+constexpr int LevelFromRaw(int raw, int max_raw) {
+  return max_raw ? (int64_t{raw} * kMaxBrightnessLevel + max_raw / 2) / max_raw
+                 : 0;
+}
+}  // namespace jjaro
+#endif  // JJARO_BRIGHTNESS_H_
@@ -8,8 +8,11 @@
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/string_view.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
 #include <dirent.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -20,6 +23,7 @@
 
 #include "deleter.h"
 #include "misc.h"
+#include "trace.h"
 // TODO
 // output
 //   open /sys/class and search for card*-$name, or fail
@@ -35,10 +39,11 @@
 
 namespace jjaro {
 namespace {
+// Reads from the start every time, so one fd can be read again and again.
 absl::StatusOr<int> ReadInt(int fd) {
   std::array<char, 64> buf;
   while (true) {
-    const ssize_t rret = read(fd, buf.data(), buf.size());
+    const ssize_t rret = pread(fd, buf.data(), buf.size(), 0);
     if (rret < 0 && errno == EINTR) continue;
     if (rret < 0) return absl::ErrnoToStatus(errno, "read failed");
     if (rret == buf.size()) return absl::InternalError("long read");
@@ -54,7 +59,8 @@ absl::StatusOr<int> ReadInt(int fd) {
 }  // namespace
 
 absl::StatusOr<std::optional<BacklightControl>> BacklightControl::Probe(
-    const absl::string_view output, const absl::string_view output_dir) {
+    const absl::string_view output, const absl::string_view output_dir,
+    const ProbeContext &ctx) {
   std::unique_ptr<DIR, Deleter<closedir>> output_dirp;
   while (true) {
     output_dirp.reset(opendir(std::string(output_dir).c_str()));
@@ -82,16 +88,18 @@ absl::StatusOr<std::optional<BacklightControl>> BacklightControl::Probe(
     } else if (!*link || !absl::EndsWith(**link, "/class/backlight")) {
       continue;
     }
-    if (auto dev = ProbeDevice(output, ent->d_name); !dev.ok() || *dev)
+    if (auto dev = ProbeDevice(output, ent->d_name, ctx); !dev.ok() || *dev)
       return dev;
   }
 }
 
 absl::StatusOr<std::optional<BacklightControl>> BacklightControl::ProbeDevice(
-    const absl::string_view output, const absl::string_view device) {
+    const absl::string_view output, const absl::string_view device,
+    const ProbeContext &ctx) {
+  const auto device_dir =
+      absl::StrCat(ctx.root, "/sys/class/backlight/", device);
   const auto max_brightness_fd =
-      Open(absl::StrCat("/sys/class/backlight/", device, "/max_brightness"),
-           O_RDONLY);
+      Open(absl::StrCat(device_dir, "/max_brightness"), O_RDONLY);
   if (!max_brightness_fd.ok())
     return absl::Status(
         max_brightness_fd.status().code(),
@@ -103,16 +111,14 @@ absl::StatusOr<std::optional<BacklightControl>> BacklightControl::ProbeDevice(
         max_brightness.status().code(),
         absl::StrCat("couldn't get ", output, " ", device,
                      "/max_brightness: ", max_brightness.status().message()));
-  auto brightness_fd = Open(
-      absl::StrCat("/sys/class/backlight/", device, "/brightness"), O_WRONLY);
+  auto brightness_fd = Open(absl::StrCat(device_dir, "/brightness"), O_WRONLY);
   if (!brightness_fd.ok())
     return absl::Status(
         brightness_fd.status().code(),
         absl::StrCat("couldn't get ", output, " ", device, "/brightness ",
                      brightness_fd.status().message()));
   auto actual_brightness_fd =
-      Open(absl::StrCat("/sys/class/backlight/", device, "/actual_brightness"),
-           O_RDONLY);
+      Open(absl::StrCat(device_dir, "/actual_brightness"), O_RDONLY);
   if (!actual_brightness_fd.ok())
     return absl::Status(actual_brightness_fd.status().code(),
                         absl::StrCat("couldn't get ", output, " ", device,
@@ -122,30 +128,78 @@ absl::StatusOr<std::optional<BacklightControl>> BacklightControl::ProbeDevice(
                           *std::move(actual_brightness_fd), *max_brightness);
 }
 
-absl::StatusOr<int> BacklightControl::GetBrightnessPercentImpl(
+absl::StatusOr<int> BacklightControl::GetRawBrightnessImpl(
     absl::FunctionRef<bool()> cancel) {
+  const absl::Time start = absl::Now();
   auto actual_brightness = ReadInt(actual_brightness_fd_.get());
+  stats().RecordRead(absl::Now() - start, actual_brightness.ok());
+  stats().RecordTransaction(0);
   if (!actual_brightness.ok())
     return absl::Status(
         actual_brightness.status().code(),
         absl::StrCat("couldn't get ", name(), " actual_brightness: ",
                      actual_brightness.status().message()));
-  return 100 * *actual_brightness / max_brightness_;
+  return *actual_brightness;
 }
 
-absl::Status BacklightControl::SetBrightnessPercentImpl(
-    int percent, absl::FunctionRef<bool()> cancel) {
-  const auto val = absl::StrCat(percent * max_brightness_ / 100);
+// The backlight class notifies `actual_brightness` pollers whenever the
+// brightness is set, through sysfs or by firmware handling hotkeys, for
+// drivers that tell it about the latter.  Others just never wake this.
+absl::Status BacklightControl::WaitForChange(int stop_fd) {
+  std::array<struct pollfd, 2> fds = {
+      {{.fd = actual_brightness_fd_.get(), .events = POLLPRI},
+       {.fd = stop_fd, .events = POLLIN}}};
   while (true) {
+    const int pret = poll(fds.data(), fds.size(), -1);
+    if (pret < 0 && errno == EINTR) continue;
+    if (pret < 0)
+      return absl::ErrnoToStatus(
+          errno, absl::StrCat("WaitForChange ", name(), " poll failed"));
+    if (fds[1].revents) return absl::CancelledError();
+    if (fds[0].revents & POLLNVAL)
+      return absl::InternalError(
+          absl::StrCat("WaitForChange ", name(), " bad fd"));
+    if (!(fds[0].revents & (POLLPRI | POLLERR))) continue;
+    // sysfs keeps reporting the change until the attribute is read again.
+    // Our own writes notify too, and one that still reads as what we saw
+    // after writing isn't news to anyone.
+    if (const auto actual = ReadInt(actual_brightness_fd_.get());
+        actual.ok() && *actual == own_change_->exchange(-1))
+      continue;
+    return absl::OkStatus();
+  }
+}
+
+absl::Status BacklightControl::SetRawBrightnessImpl(
+    int raw, absl::FunctionRef<bool()> cancel) {
+  TraceScope trace("BacklightControl::SetRawBrightnessImpl");
+  trace.Arg("raw", raw);
+  // Formatted on the stack, as it's written on every step of a fade.
+  const absl::AlphaNum val(raw);
+  stats().RecordTransaction(0);
+  own_change_->store(-1);
+  while (true) {
+    const absl::Time start = absl::Now();
     const ssize_t wret = write(brightness_fd_.get(), val.data(), val.size());
     if (wret < 0 && errno == EINTR) continue;
+    stats().RecordWrite(absl::Now() - start, wret >= 0);
     if (wret < 0)
       return absl::ErrnoToStatus(
           errno, absl::StrCat("SetBrightness ", name(), " write failed"));
-    if (wret < val.size())
+    if (wret < static_cast<ssize_t>(val.size()))
       return absl::InternalError(
           absl::StrCat("SetBrightness ", name(), " short write"));
-    return absl::OkStatus();
+    break;
+  }
+  // Some drivers keep `actual_brightness` in steps of their own, so what it
+  // reads as now is what later reads are checked against.
+  const absl::Time start = absl::Now();
+  const auto actual = ReadInt(actual_brightness_fd_.get());
+  stats().RecordRead(absl::Now() - start, actual.ok());
+  if (actual.ok()) {
+    ReadBack(raw, *actual);
+    own_change_->store(*actual);
   }
+  return absl::OkStatus();
 }
 }  // namespace jjaro
@@ -1,8 +1,11 @@
 #ifndef JJARO_CONTROL_BACKLIGHT_H_
 #define JJARO_CONTROL_BACKLIGHT_H_ 1
+#include <absl/status/status.h>
 #include <absl/status/statusor.h>
 #include <absl/strings/string_view.h>
 
+#include <atomic>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
@@ -13,13 +16,19 @@
 namespace jjaro {
 class BacklightControl : public Control {
  public:
+  static constexpr absl::string_view kBackend = "backlight";
   static absl::StatusOr<std::optional<BacklightControl>> Probe(
-      absl::string_view output, absl::string_view output_dir);
+      absl::string_view output, absl::string_view output_dir,
+      const ProbeContext &ctx);
   static absl::StatusOr<std::optional<BacklightControl>> ProbeDevice(
-      absl::string_view output, absl::string_view device);
+      absl::string_view output, absl::string_view device,
+      const ProbeContext &ctx);
   BacklightControl(BacklightControl &&) = default;
   BacklightControl &operator=(BacklightControl &&) = default;
   ~BacklightControl() override = default;
+  absl::string_view backend() const override { return kBackend; }
+  bool reports_changes() const override { return true; }
+  absl::Status WaitForChange(int stop_fd) override;
 
  private:
   BacklightControl(std::string name, FDHolder brightness_fd,
@@ -28,13 +37,19 @@ class BacklightControl : public Control {
         brightness_fd_(std::move(brightness_fd)),
         actual_brightness_fd_(std::move(actual_brightness_fd)),
         max_brightness_(max_brightness) {}
-  absl::StatusOr<int> GetBrightnessPercentImpl(
+  absl::StatusOr<int> GetRawBrightnessImpl(
       absl::FunctionRef<bool()> cancel) override;
-  absl::Status SetBrightnessPercentImpl(
-      int percent, absl::FunctionRef<bool()> cancel) override;
+  absl::Status SetRawBrightnessImpl(int raw,
+                                    absl::FunctionRef<bool()> cancel) override;
+  int max_raw_brightness() const override { return max_brightness_; }
 
   FDHolder brightness_fd_, actual_brightness_fd_;
   int max_brightness_;
+  // What `actual_brightness` read as just after our last write, until the
+  // notification that write raises is seen, or -1.  Held by pointer to keep
+  // this movable.
+  std::unique_ptr<std::atomic<int>> own_change_ =
+      std::make_unique<std::atomic<int>>(-1);
 };
 }  // namespace jjaro
 #endif  // JJARO_CONTROL_BACKLIGHT_H_
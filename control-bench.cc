@@ -0,0 +1,145 @@
+// The CPU cost of the control side of a brightness change: building and
+// checking DDC/CI packets, and backlight writes and reads against regular
+// files standing in for sysfs, so what's left is the daemon's own overhead.
+#include <absl/status/status.h>
+#include <absl/strings/str_cat.h>
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "control-ddc-i2c.h"
+#include "control.h"
+#include "ddc-ci.h"
+#include "edid-cache.h"
+#include "sysfs-fixture.h"
+
+namespace jjaro {
+namespace {
+void BM_DDCGetVCPRequest(benchmark::State &state) {
+  uint8_t code = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(ddc::GetVCPRequest(std::byte{code++}));
+}
+BENCHMARK(BM_DDCGetVCPRequest);
+
+void BM_DDCSetVCPRequest(benchmark::State &state) {
+  uint16_t value = 0;
+  for (auto _ : state)
+    benchmark::DoNotOptimize(
+        ddc::SetVCPRequest(ddc::kVCPBrightness, value++));
+}
+BENCHMARK(BM_DDCSetVCPRequest);
+
+// A brightness reply as read off the bus, with the host read address the
+// checksum starts from in front.  `corrupt` flips a bit so it fails.
+void BM_DDCValidateGetVCPResp(benchmark::State &state) {
+  std::array<std::byte, 12> resp{ddc::kHostReadAddr,
+                                 ddc::kDeviceWriteAddr,
+                                 ddc::LengthByte(8),
+                                 ddc::kOpCodeGetVCPResp,
+                                 std::byte{0},
+                                 ddc::kVCPBrightness,
+                                 std::byte{0},
+                                 std::byte{0},
+                                 std::byte{100},
+                                 std::byte{0},
+                                 std::byte{50}};
+  resp.back() = ddc::Checksum(resp);
+  if (state.range(0)) resp[10] ^= std::byte{1};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(resp);
+    const absl::Status vs = I2CDDCControl::ValidateGetVCPResp(
+        resp,
+        {.op = "GetVCP", .code = ddc::kVCPBrightness, .device = "bench"});
+    if (vs.ok() == static_cast<bool>(state.range(0))) {
+      state.SkipWithError(vs.ToString().c_str());
+      return;
+    }
+  }
+}
+BENCHMARK(BM_DDCValidateGetVCPResp)->ArgName("corrupt")->Arg(0)->Arg(1);
+
+// A backlight's `SetBrightnessPercent`, through to a write(2) of its own.
+// Every percent is a different raw value, so none of these are skipped.
+void BM_BacklightSetBrightness(benchmark::State &state) {
+  auto sysfs = SyntheticSysfs::Create({.backlights = 1});
+  if (!sysfs.ok()) {
+    state.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EDIDCache edid_cache;
+  auto control = Control::Probe(
+      sysfs->outputs()[0], {.root = sysfs->root(), .edid_cache = &edid_cache});
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int percent = 0;
+  for (auto _ : state) {
+    if (const auto ss = (*control)->SetBrightnessPercent(percent); !ss.ok()) {
+      state.SkipWithError(ss.ToString().c_str());
+      return;
+    }
+    percent = (percent + 1) % 101;
+  }
+}
+BENCHMARK(BM_BacklightSetBrightness);
+
+// Reading a backlight back over and over through the one fd it keeps open,
+// as outputs do whenever it reports a change.
+void BM_BacklightGetBrightness(benchmark::State &state) {
+  auto sysfs = SyntheticSysfs::Create({.backlights = 1});
+  if (!sysfs.ok()) {
+    state.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EDIDCache edid_cache;
+  auto control = Control::Probe(
+      sysfs->outputs()[0], {.root = sysfs->root(), .edid_cache = &edid_cache});
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  for (auto _ : state) {
+    if (const auto level = (*control)->GetBrightnessLevel(); !level.ok()) {
+      state.SkipWithError(level.status().ToString().c_str());
+      return;
+    }
+  }
+}
+BENCHMARK(BM_BacklightGetBrightness);
+
+// A fade through every level, up and down, on a backlight with 1000 steps.
+// Only levels that reach a new step should cost a write.
+void BM_BacklightFadeLevels(benchmark::State &state) {
+  auto sysfs = SyntheticSysfs::Create({.backlights = 1});
+  if (!sysfs.ok()) {
+    state.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EDIDCache edid_cache;
+  auto control = Control::Probe(
+      sysfs->outputs()[0], {.root = sysfs->root(), .edid_cache = &edid_cache});
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int level = 0, step = 1;
+  for (auto _ : state) {
+    if (const auto ss = (*control)->SetBrightnessLevel(level); !ss.ok()) {
+      state.SkipWithError(ss.ToString().c_str());
+      return;
+    }
+    if (level + step < 0 || level + step > kMaxBrightnessLevel) step = -step;
+    level += step;
+  }
+  state.counters["writes"] =
+      benchmark::Counter((*control)->stats().transactions.load(),
+                         benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_BacklightFadeLevels);
+}  // namespace
+}  // namespace jjaro
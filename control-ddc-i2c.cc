@@ -7,52 +7,55 @@
 #include <absl/strings/match.h>
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
 #include <absl/strings/string_view.h>
 #include <absl/time/clock.h>
 #include <absl/time/time.h>
 #include <absl/types/span.h>
 #include <dirent.h>
 #include <fcntl.h>
-#include <linux/i2c-dev.h>
-#include <linux/i2c.h>
-#include <sys/ioctl.h>
 #include <sys/stat.h>
 #include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cerrno>
 #include <cstddef>
 #include <cstdint>
-#include <cstring>
+#include <cstdio>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "ddc-ci.h"
+#include "ddc-pacer.h"
 #include "deleter.h"
+#include "edid.h"
 #include "fd-holder.h"
 #include "misc.h"
+#include "stats.h"
+#include "trace.h"
 
 namespace jjaro {
 namespace {
+using ddc::Checksum;
+using ddc::GetVCPRequest;
+using ddc::kDeviceWriteAddr;
+using ddc::kHostReadAddr;
+using ddc::kOpCodeGetVCPResp;
+using ddc::kVCPBrightness;
+using ddc::LengthByte;
+using ddc::SetVCPRequest;
 constexpr int kTries = 10;
-constexpr long kDeviceBusAddr{0x37};
-constexpr std::byte kDeviceWriteAddr{0x6e};
-constexpr std::byte kHostWriteAddr{0x51};
-constexpr std::byte kHostReadAddr{0x50};
-constexpr std::byte LengthByte(size_t sz) {
-  return static_cast<std::byte>(0x80 + sz);
-}
-constexpr std::byte kOpCodeGetVCPReq{0x01};
-constexpr std::byte kOpCodeGetVCPResp{0x02};
-constexpr std::byte kOpCodeSetVCPReq{0x03};
-constexpr std::byte kVCPBrightness{0x10};
-constexpr std::byte Checksum(absl::Span<const std::byte> buf) {
-  std::byte cksum{0};
-  for (std::byte b : buf) cksum ^= b;
-  return cksum;
-}
+constexpr int kVerifyTries = 3;
+// Bounds on the learned Get VCP reply delay.
+constexpr absl::Duration kMaxReplyDelay = absl::Milliseconds(500);
+constexpr absl::Duration kMinReplyDelay = absl::Milliseconds(2);
+constexpr absl::Duration kReplyPollInterval = absl::Milliseconds(5);
+constexpr int kMaxFastRepliesBeforeShrinking = 1024;
 
 absl::StatusOr<dev_t> ReadDev(int fd) {
   std::array<char, 64> buf;
@@ -80,15 +83,31 @@ absl::StatusOr<dev_t> ReadDev(int fd) {
   }
 }
 
-absl::StatusOr<std::string> ReadStr(int fd, size_t max_size) {
-  std::string buf(max_size, '0');
-  while (true) {
-    const ssize_t rret = read(fd, buf.data(), buf.size());
-    if (rret < 0 && errno == EINTR) continue;
-    if (rret < 0) return absl::ErrnoToStatus(errno, "read failed");
-    buf.resize(rret);
-    return buf;
-  }
+// DPMST buses all tunnel through their branch's one DP AUX channel, so they
+// have to take turns on it.  sysfs doesn't say which channel an MST adapter
+// goes over, only which GPU it hangs off, so they're paced per GPU, which
+// errs on the side of waiting.  Every other bus is its own link.
+std::string LinkFor(const absl::string_view device, const ProbeContext &ctx) {
+  const std::string adapter =
+      absl::StrCat(ctx.root, "/sys/bus/i2c/devices/", device);
+  const auto name_fd = Open(absl::StrCat(adapter, "/name"), O_RDONLY);
+  if (!name_fd.ok()) return std::string(device);
+  const auto name = ReadStr(name_fd->get(), 64);
+  if (!name.ok() || absl::StripAsciiWhitespace(*name) != "DPMST")
+    return std::string(device);
+  const auto link = Readlink(adapter);
+  if (!link.ok() || !*link) return std::string(device);
+  absl::string_view parent = **link;
+  parent = parent.substr(0, parent.rfind('/'));
+  if (const size_t slash = parent.rfind('/'); slash != parent.npos)
+    parent = parent.substr(slash + 1);
+  return absl::StrCat(parent, " DPMST");
+}
+
+std::shared_ptr<DDCPacer> PacerFor(const absl::string_view device,
+                                   const ProbeContext &ctx) {
+  if (!ctx.ddc_pacers) return std::make_shared<DDCPacer>();
+  return ctx.ddc_pacers->Get(LinkFor(device, ctx));
 }
 
 absl::StatusOr<dev_t> StatDev(int fd) {
@@ -105,7 +124,8 @@ absl::StatusOr<dev_t> StatDev(int fd) {
 }  // namespace
 
 absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::Probe(
-    const absl::string_view output, const absl::string_view output_dir) {
+    const absl::string_view output, const absl::string_view output_dir,
+    const ProbeContext &ctx) {
   // Try ${output}/ddc and collect ${output}/i2c-* to try next.
   std::unique_ptr<DIR, Deleter<closedir>> output_dirp;
   while (true) {
@@ -137,7 +157,7 @@ absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::Probe(
         absl::string_view device = **link;
         if (const size_t slash = device.rfind('/'); slash != device.npos)
           device = device.substr(slash + 1);
-        if (auto dev = ProbeDevice(output, device); !dev.ok() || *dev)
+        if (auto dev = ProbeDevice(output, device, ctx); !dev.ok() || *dev)
           return dev;
       }
     }
@@ -146,7 +166,8 @@ absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::Probe(
     }
   }
   for (const std::string &device : devs)
-    if (auto dev = ProbeDevice(output, device); !dev.ok() || *dev) return dev;
+    if (auto dev = ProbeDevice(output, device, ctx); !dev.ok() || *dev)
+      return dev;
   // DP MST DDC buses aren't populated under ${output}, so we have to look
   // through ${card}/i2c-*.  sysfs doesn't tell us which one is which output,
   // so we read the EDID and compare.
@@ -156,7 +177,7 @@ absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::Probe(
         edid_fd.status().code(),
         absl::StrCat(output, " could not read EDID from sysfs: ",
                      edid_fd.status().message()));
-  const auto sysfs_edid = ReadStr(edid_fd->get(), 128);
+  const auto sysfs_edid = ReadStr(edid_fd->get(), kEDIDMaxSize);
   if (!sysfs_edid.ok())
     return absl::Status(
         sysfs_edid.status().code(),
@@ -189,7 +210,7 @@ absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::Probe(
     auto name = ReadStr(name_fd->get(), 64);
     if (!name.ok()) continue;
     if (absl::StripAsciiWhitespace(*name) != "DPMST") continue;
-    if (auto dev = ProbeDevice(output, ent->d_name, *sysfs_edid);
+    if (auto dev = ProbeDevice(output, ent->d_name, ctx, *sysfs_edid);
         !dev.ok() || *dev)
       return dev;
   }
@@ -197,10 +218,72 @@ absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::Probe(
 
 absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::ProbeDevice(
     const absl::string_view output, const absl::string_view device,
-    const absl::string_view match_edid) {
-  const auto dev_nums_fd = Open(absl::StrCat("/sys/bus/i2c/devices/", device,
-                                             "/i2c-dev/", device, "/dev"),
-                                O_RDONLY);
+    const ProbeContext &ctx, const absl::string_view match_edid) {
+  auto transport = OpenDevice(output, device, ctx, match_edid);
+  if (!transport.ok()) return transport.status();
+  if (!*transport) return std::nullopt;
+  return Create(std::string(device), *std::move(transport),
+                ctx.ddc_verify_every, PacerFor(device, ctx));
+}
+
+absl::StatusOr<I2CDDCControl> I2CDDCControl::Create(
+    std::string name, std::unique_ptr<I2CTransport> transport,
+    const int verify_every, std::shared_ptr<DDCPacer> pacer) {
+  if (!pacer) pacer = std::make_shared<DDCPacer>();
+  I2CDDCControl ddc(std::move(name), std::move(transport), std::move(pacer),
+                    verify_every);
+  if (auto read = ddc.GetBrightnessPercent().status(); !read.ok()) return read;
+  return ddc;
+}
+
+absl::StatusOr<bool> I2CDDCControl::IsConnectorBus(
+    const absl::string_view output, const absl::string_view output_dir,
+    const absl::string_view device) {
+  while (true) {
+    if (access(absl::StrCat(output_dir, "/", device).c_str(), F_OK) == 0)
+      return true;
+    if (errno == EINTR) continue;
+    if (errno == ENOENT) break;
+    return absl::ErrnoToStatus(
+        errno, absl::StrCat(output, " ", device, ": access failed"));
+  }
+  const auto link = Readlink(absl::StrCat(output_dir, "/ddc"));
+  if (!link.ok())
+    return absl::Status(
+        link.status().code(),
+        absl::StrCat(output, " ddc: ", link.status().message()));
+  return *link && absl::EndsWith(**link, absl::StrCat("/", device));
+}
+
+// The VCP maximum is taken on trust, so this skips the Get VCP round trip
+// `ProbeDevice` uses to learn it.  Buses that aren't linked from the
+// connector must be DP MST branches, whose numbering can shift between hub
+// replugs, so those are still checked against the EDID.
+absl::StatusOr<std::optional<I2CDDCControl>>
+I2CDDCControl::ProbeCachedDevice(const absl::string_view output,
+                                 const absl::string_view output_dir,
+                                 const absl::string_view device,
+                                 const int max_brightness,
+                                 const absl::string_view sysfs_edid,
+                                 const ProbeContext &ctx) {
+  if (max_brightness <= 0) return std::nullopt;
+  const auto own = IsConnectorBus(output, output_dir, device);
+  if (!own.ok()) return own.status();
+  auto transport = OpenDevice(output, device, ctx, *own ? "" : sysfs_edid);
+  if (!transport.ok()) return transport.status();
+  if (!*transport) return std::nullopt;
+  return I2CDDCControl(std::string(device), *std::move(transport),
+                       PacerFor(device, ctx), ctx.ddc_verify_every,
+                       max_brightness);
+}
+
+absl::StatusOr<std::unique_ptr<I2CTransport>> I2CDDCControl::OpenDevice(
+    const absl::string_view output, const absl::string_view device,
+    const ProbeContext &ctx, const absl::string_view match_edid) {
+  const auto dev_nums_fd =
+      Open(absl::StrCat(ctx.root, "/sys/bus/i2c/devices/", device,
+                        "/i2c-dev/", device, "/dev"),
+           O_RDONLY);
   if (!dev_nums_fd.ok())
     return absl::Status(
         dev_nums_fd.status().code(),
@@ -214,179 +297,297 @@ absl::StatusOr<std::optional<I2CDDCControl>> I2CDDCControl::ProbeDevice(
         absl::StrCat(output, " ", device,
                      " could not read device number from sysfs: ",
                      sysfs_dev_nums.status().message()));
-  auto dev_fd = Open(absl::StrCat("/dev/", device), O_RDWR);
-  if (!dev_fd.ok())
-    return absl::Status(dev_fd.status().code(),
-                        absl::StrCat(output, " could not open device node /dev",
-                                     device, ": ", dev_fd.status().message()));
-  const auto devfs_dev_nums = StatDev(dev_fd->get());
-  if (!devfs_dev_nums.ok())
-    return absl::Status(
-        devfs_dev_nums.status().code(),
-        absl::StrCat(output, " ", device,
-                     " could not read device number from sysfs: ",
-                     devfs_dev_nums.status().message()));
-  if (*sysfs_dev_nums != *devfs_dev_nums)
-    return absl::InternalError(
-        absl::StrCat("/dev/", device, " device number ", major(*devfs_dev_nums),
-                     ":", minor(*devfs_dev_nums), " doesn't match sysfs ",
-                     major(*sysfs_dev_nums), ":", minor(*sysfs_dev_nums)));
+  std::unique_ptr<I2CTransport> transport;
+  if (ctx.i2c_opener) {
+    auto opened = ctx.i2c_opener->Open(device);
+    if (!opened.ok())
+      return absl::Status(opened.status().code(),
+                          absl::StrCat(output, " could not open ", device, ": ",
+                                       opened.status().message()));
+    transport = *std::move(opened);
+  } else {
+    auto dev_fd = Open(absl::StrCat(ctx.root, "/dev/", device), O_RDWR);
+    if (!dev_fd.ok())
+      return absl::Status(
+          dev_fd.status().code(),
+          absl::StrCat(output, " could not open device node /dev/", device,
+                       ": ", dev_fd.status().message()));
+    const auto devfs_dev_nums = StatDev(dev_fd->get());
+    if (!devfs_dev_nums.ok())
+      return absl::Status(
+          devfs_dev_nums.status().code(),
+          absl::StrCat(output, " ", device,
+                       " could not read device number from devfs: ",
+                       devfs_dev_nums.status().message()));
+    if (*sysfs_dev_nums != *devfs_dev_nums)
+      return absl::InternalError(absl::StrCat(
+          "/dev/", device, " device number ", major(*devfs_dev_nums), ":",
+          minor(*devfs_dev_nums), " doesn't match sysfs ",
+          major(*sysfs_dev_nums), ":", minor(*sysfs_dev_nums)));
+    auto dev = DevI2CTransport::Create(*std::move(dev_fd));
+    if (!dev.ok())
+      return absl::Status(dev.status().code(),
+                          absl::StrCat(output, " ", device, " ",
+                                       dev.status().message()));
+    transport = *std::move(dev);
+  }
   if (!match_edid.empty()) {
-    const auto ddc_edid = I2CDDCControl::ReadEDID(dev_fd->get());
+    const auto read_edid = [&transport] { return transport->ReadEDID(); };
+    const auto ddc_edid =
+        ctx.edid_cache ? ctx.edid_cache->Get(*sysfs_dev_nums, read_edid)
+                       : read_edid();
     if (!ddc_edid.ok())
       return absl::Status(
           ddc_edid.status().code(),
           absl::StrCat(output, " ", device,
                        " failed to read EDID: ", ddc_edid.status().message()));
-    if (*ddc_edid != match_edid) return std::nullopt;
-  }
-  while (true) {
-    const int ret = ioctl(dev_fd->get(), I2C_SLAVE, kDeviceBusAddr);
-    if (ret != 0 && errno == EINTR) continue;
-    if (ret != 0)
-      return absl::ErrnoToStatus(
-          errno, absl::StrCat(output, " ", device,
-                              " failed to set I2C_SLAVE address 0x",
-                              absl::Hex(kDeviceBusAddr)));
-    break;
+    if (!EDIDMatches(*ddc_edid, match_edid)) return nullptr;
   }
-  I2CDDCControl ddc(std::string(device), *std::move(dev_fd));
-  if (auto read = ddc.GetBrightnessPercent().status(); !read.ok()) return read;
-  return ddc;
+  return transport;
+}
+
+absl::StatusOr<int> I2CDDCControl::GetRawBrightnessImpl(
+    absl::FunctionRef<bool()> cancel) {
+  const auto brightness = GetVCP(kVCPBrightness, cancel);
+  if (!brightness.ok()) return brightness.status();
+  if (brightness->max == 0)
+    return absl::InternalError(
+        absl::StrCat("GetBrightness ", name(), " zero max brightness"));
+  max_brightness_ = brightness->max;
+  last_read_ = brightness->value;
+  return brightness->value;
+}
+
+absl::StatusOr<VCPValue> I2CDDCControl::GetVCPFeatureImpl(
+    const uint8_t code, absl::FunctionRef<bool()> cancel) {
+  return GetVCP(static_cast<std::byte>(code), cancel);
 }
 
-absl::StatusOr<int> I2CDDCControl::GetBrightnessPercentImpl(
+absl::Status I2CDDCControl::SetVCPFeatureImpl(
+    const uint8_t code, const uint16_t value,
     absl::FunctionRef<bool()> cancel) {
-  const auto error = absl::StrCat("GetBrightness ", name());
-  std::array<std::byte, 6> req{kDeviceWriteAddr, kHostWriteAddr, LengthByte(2),
-                               kOpCodeGetVCPReq, kVCPBrightness, std::byte{0}};
-  req.back() = Checksum(req);
+  return SetVCP(static_cast<std::byte>(code), value, cancel);
+}
+
+absl::StatusOr<VCPValue> I2CDDCControl::GetVCP(
+    const std::byte code, absl::FunctionRef<bool()> cancel) {
+  int retries = 0;
+  auto ret = pacer_->Run([&] { return GetVCPUnpaced(code, cancel, &retries); });
+  Record([retries](TransportStats &s) { s.RecordTransaction(retries); });
+  return ret;
+}
+
+absl::StatusOr<VCPValue> I2CDDCControl::GetVCPUnpaced(
+    const std::byte code, absl::FunctionRef<bool()> cancel, int *retries) {
+  const Command command{.op = "GetVCP", .code = code, .device = name()};
+  const auto req = GetVCPRequest(code);
   for (int i = kTries; i; i--) {
-    if (cancel()) return absl::CancelledError("GetBrightness cancelled");
-    auto ws = TryWrite(absl::MakeSpan(req).subspan(1), error);
+    if (cancel()) return absl::CancelledError("GetVCP cancelled");
+    auto ws = TryWrite(absl::MakeConstSpan(req).subspan(1), command);
     if (!ws.ok() && i == 1) return ws;
-    if (!ws.ok()) continue;
+    if (!ws.ok()) {
+      ++*retries;
+      TraceInstant("retry");
+      continue;
+    }
     break;
   }
-  absl::SleepFor(absl::Milliseconds(40));
+  absl::Duration waited = reply_delay_;
+  absl::SleepFor(waited);
   std::array<std::byte, 12> resp{kHostReadAddr, std::byte{0}};
   for (int i = kTries; i; i--) {
-    if (cancel()) return absl::CancelledError("GetBrightness cancelled");
-    auto rs = TryRead(absl::MakeSpan(resp).subspan(1), error);
-    if (!rs.ok() && i == 1) return rs;
-    if (!rs.ok()) continue;
-    auto vs = ValidateBrightnessResp(resp, error);
-    if (!vs.ok() && i == 1) return vs;
-    if (!vs.ok()) continue;
-    break;
+    if (cancel()) return absl::CancelledError("GetVCP cancelled");
+    auto rs = TryRead(absl::MakeSpan(resp).subspan(1), command);
+    if (rs.ok()) rs = ValidateGetVCPResp(resp, command);
+    if (absl::IsDataLoss(rs))
+      Record([](TransportStats &s) {
+        s.checksum_failures.fetch_add(1, std::memory_order_relaxed);
+      });
+    if (rs.ok()) {
+      LearnReplyDelay(waited, i == kTries);
+      break;
+    }
+    if (i == 1) {
+      // Nothing came back in time, so give the next request longer.
+      SetReplyDelay(std::min(2 * reply_delay_, kMaxReplyDelay));
+      return rs;
+    }
+    // Most failures here are the monitor answering with a null message
+    // because it isn't done yet, so wait a little before asking again.
+    ++*retries;
+    TraceInstant("retry");
+    absl::SleepFor(kReplyPollInterval);
+    waited += kReplyPollInterval;
+  }
+  return VCPValue{
+      .value = static_cast<uint16_t>(static_cast<uint16_t>(resp[9]) << 8 |
+                                     static_cast<uint16_t>(resp[10])),
+      .max = static_cast<uint16_t>(static_cast<uint16_t>(resp[7]) << 8 |
+                                   static_cast<uint16_t>(resp[8]))};
+}
+
+// Replies that come back on the first read are evidence the delay could be
+// shorter, so after a run of them, try shaving a quarter off.  A reply that
+// needed polling says how long the monitor really takes, so the delay jumps
+// straight to that plus some margin.
+// Each time that overshoots, the run needed before trying again doubles, so
+// the delay settles rather than oscillating around the monitor's real speed.
+void I2CDDCControl::LearnReplyDelay(const absl::Duration waited,
+                                    const bool first_read) {
+  if (!first_read) {
+    fast_replies_ = 0;
+    fast_replies_needed_ =
+        std::min(2 * fast_replies_needed_, kMaxFastRepliesBeforeShrinking);
+    SetReplyDelay(std::min(waited + waited / 8, kMaxReplyDelay));
+  } else if (++fast_replies_ >= fast_replies_needed_) {
+    fast_replies_ = 0;
+    SetReplyDelay(std::max(reply_delay_ * 3 / 4, kMinReplyDelay));
   }
-  const int brightness =
-      static_cast<uint16_t>(resp[9]) << 8 | static_cast<uint16_t>(resp[10]);
-  max_brightness_ =
-      static_cast<uint16_t>(resp[7]) << 8 | static_cast<uint16_t>(resp[8]);
-  return 100 * brightness / max_brightness_;
 }
 
-absl::Status I2CDDCControl::SetBrightnessPercentImpl(
-    int percent, absl::FunctionRef<bool()> cancel) {
-  const auto error = absl::StrCat("SetBrightness ", name());
-  uint16_t val = percent * max_brightness_ / 100;
-  std::array<std::byte, 8> req{kDeviceWriteAddr,
-                               kHostWriteAddr,
-                               LengthByte(4),
-                               kOpCodeSetVCPReq,
-                               kVCPBrightness,
-                               static_cast<std::byte>(val >> 8),
-                               static_cast<std::byte>(val)};
-  req.back() = Checksum(req);
+void I2CDDCControl::SetReplyDelay(const absl::Duration delay) {
+  if (delay == reply_delay_) return;
+  reply_delay_ = delay;
+  PublishReplyDelay();
+#ifndef NDEBUG
+  absl::FPrintF(stderr, "DDC reply delay for %s is now %s.\n", name(),
+                absl::FormatDuration(reply_delay_));
+#endif
+}
+
+absl::Status I2CDDCControl::SetRawBrightnessImpl(
+    int raw, absl::FunctionRef<bool()> cancel) {
+  const uint16_t val = raw;
+  if (auto ws = SetVCP(kVCPBrightness, val, cancel); !ws.ok()) return ws;
+  unverified_value_ = val;
+  if (verify_every_ > 0 && ++writes_since_verify_ >= verify_every_)
+    return VerifyBrightnessImpl(cancel);
+  return absl::OkStatus();
+}
+
+absl::Status I2CDDCControl::SetVCP(const std::byte code, const uint16_t val,
+                                   absl::FunctionRef<bool()> cancel) {
+  int retries = 0;
+  auto ret =
+      pacer_->Run([&] { return SetVCPUnpaced(code, val, cancel, &retries); });
+  Record([retries](TransportStats &s) { s.RecordTransaction(retries); });
+  return ret;
+}
+
+absl::Status I2CDDCControl::SetVCPUnpaced(const std::byte code,
+                                          const uint16_t val,
+                                          absl::FunctionRef<bool()> cancel,
+                                          int *retries) {
+  const Command command{.op = "SetVCP", .code = code, .device = name()};
+  const auto req = SetVCPRequest(code, val);
   for (int i = kTries; i; i--) {
-    if (cancel()) return absl::CancelledError("SetBrightness cancelled");
-    auto ws = TryWrite(absl::MakeSpan(req).subspan(1), error);
-    if (!ws.ok() && !i) return ws;
-    if (!ws.ok()) continue;
+    if (cancel()) return absl::CancelledError("SetVCP cancelled");
+    auto ws = TryWrite(absl::MakeConstSpan(req).subspan(1), command);
+    if (!ws.ok() && i == 1) return ws;
+    if (!ws.ok()) {
+      ++*retries;
+      TraceInstant("retry");
+      continue;
+    }
     break;
   }
   return absl::OkStatus();
 }
 
-absl::Status I2CDDCControl::TryWrite(absl::Span<const std::byte> buf,
-                                     absl::string_view error) {
-  while (true) {
-    const ssize_t wret = write(fd_.get(), buf.data(), buf.size());
-    if (wret < 0 && errno == EINTR) continue;
-    if (wret < 0)
-      return absl::ErrnoToStatus(errno, absl::StrCat(error, " write failed"));
-    if (wret != static_cast<ssize_t>(buf.size()))
-      return absl::ErrnoToStatus(errno, absl::StrCat(error, " short write"));
-    return absl::OkStatus();
+// Set VCP has no reply, so a write the monitor dropped or mangled is only
+// caught by reading the value back.  Some monitors round what they're given,
+// so a value that moved, just not all the way, is taken as applied.  One that
+// stayed where it last read as is only a dropped write on monitors that have
+// never been seen rounding, since the others may have rounded it back there.
+absl::Status I2CDDCControl::VerifyBrightnessImpl(
+    absl::FunctionRef<bool()> cancel) {
+  if (!unverified_value_) return absl::OkStatus();
+  writes_since_verify_ = 0;
+  const uint16_t want = *unverified_value_;
+  for (int i = kVerifyTries; i; i--) {
+    const auto got = GetVCP(kVCPBrightness, cancel);
+    if (!got.ok()) return got.status();
+    const std::optional<uint16_t> before = last_read_;
+    last_read_ = got->value;
+    if (got->value == want) break;
+    if (got->value != before || rounds_) {
+      rounds_ = true;
+      unverified_value_.reset();
+      ReadBack(want, got->value);
+      return absl::OkStatus();
+    }
+    if (i == 1) {
+      unverified_value_.reset();
+      return absl::InternalError(absl::StrCat("SetBrightness ", name(),
+                                              " didn't take: wrote ", want,
+                                              " but it stayed at ",
+                                              got->value));
+    }
+    if (auto ws = SetVCP(kVCPBrightness, want, cancel); !ws.ok()) return ws;
   }
+  unverified_value_.reset();
+  return absl::OkStatus();
+}
+
+absl::Status I2CDDCControl::TryWrite(absl::Span<const std::byte> buf,
+                                     const Command &command) {
+  TraceScope trace("I2CDDCControl::TryWrite");
+  const absl::Time start = absl::Now();
+  const auto ws = transport_->Write(buf);
+  const absl::Duration took = absl::Now() - start;
+  trace.Arg("bytes", buf.size());
+  trace.Arg("acked", ws.ok());
+  Record([&](TransportStats &s) { s.RecordWrite(took, ws.ok()); });
+  if (!ws.ok())
+    return absl::Status(ws.code(),
+                        absl::StrCat(command.Describe(), " ", ws.message()));
+  return absl::OkStatus();
 }
 absl::Status I2CDDCControl::TryRead(absl::Span<std::byte> buf,
-                                    absl::string_view error) {
-  while (true) {
-    const ssize_t rret = read(fd_.get(), buf.data(), buf.size());
-    if (rret < 0 && errno == EINTR) continue;
-    if (rret < 0)
-      return absl::ErrnoToStatus(errno, absl::StrCat(error, " read failed"));
-    if (rret != static_cast<ssize_t>(buf.size()))
-      return absl::ErrnoToStatus(errno, absl::StrCat(error, " short read"));
-    return absl::OkStatus();
-  }
+                                    const Command &command) {
+  TraceScope trace("I2CDDCControl::TryRead");
+  const absl::Time start = absl::Now();
+  const auto rs = transport_->Read(buf);
+  const absl::Duration took = absl::Now() - start;
+  trace.Arg("bytes", buf.size());
+  trace.Arg("acked", rs.ok());
+  Record([&](TransportStats &s) { s.RecordRead(took, rs.ok()); });
+  if (!rs.ok())
+    return absl::Status(rs.code(),
+                        absl::StrCat(command.Describe(), " ", rs.message()));
+  return absl::OkStatus();
 }
-absl::Status I2CDDCControl::ValidateBrightnessResp(
-    absl::Span<const std::byte> buf, absl::string_view error) {
+std::string I2CDDCControl::Command::Describe() const {
+  return absl::StrCat(op, " 0x", absl::Hex(code), " ", device);
+}
+
+absl::Status I2CDDCControl::ValidateGetVCPResp(absl::Span<const std::byte> buf,
+                                               const Command &command) {
   if (buf[1] != kDeviceWriteAddr)
-    return absl::InternalError(absl::StrCat(
-        error, " unexpected source address 0x", absl::Hex(buf[1])));
-  if (buf[2] != LengthByte(8))
     return absl::InternalError(
-        absl::StrCat(error, " unexpected length 0x", absl::Hex(buf[2])));
+        absl::StrCat(command.Describe(), " unexpected source address 0x",
+                     absl::Hex(buf[1])));
+  if (buf[2] != LengthByte(8))
+    return absl::InternalError(absl::StrCat(
+        command.Describe(), " unexpected length 0x", absl::Hex(buf[2])));
   if (buf[3] != kOpCodeGetVCPResp)
-    return absl::InternalError(
-        absl::StrCat(error, " unexpected resp opcode 0x", absl::Hex(buf[3])));
+    return absl::InternalError(absl::StrCat(
+        command.Describe(), " unexpected resp opcode 0x", absl::Hex(buf[3])));
   if (buf[4] != std::byte{0})
-    return absl::InternalError(
-        absl::StrCat(error, " resp error 0x", absl::Hex(buf[4])));
-  if (buf[5] != kVCPBrightness)
     return absl::InternalError(absl::StrCat(
-        error, " unexpected resp req opcode 0x", absl::Hex(buf[5])));
-  if (buf[6] != std::byte{0})
+        command.Describe(), " resp error 0x", absl::Hex(buf[4])));
+  if (buf[5] != command.code)
     return absl::InternalError(
-        absl::StrCat(error, " unexpected resp type 0x", absl::Hex(buf[6])));
-  if (buf[7] == std::byte{0} && buf[8] == std::byte{0})
-    return absl::InternalError(absl::StrCat(error, " zero max brightness"));
+        absl::StrCat(command.Describe(), " unexpected resp req opcode 0x",
+                     absl::Hex(buf[5])));
+  // Set parameter or momentary; anything else is noise.
+  if (buf[6] != std::byte{0} && buf[6] != std::byte{1})
+    return absl::InternalError(absl::StrCat(
+        command.Describe(), " unexpected resp type 0x", absl::Hex(buf[6])));
   if (Checksum(buf) != std::byte{0})
-    return absl::InternalError(absl::StrCat(error, " bad resp checksum"));
+    return absl::DataLossError(
+        absl::StrCat(command.Describe(), " bad resp checksum"));
   return absl::OkStatus();
 }
 
-absl::StatusOr<std::string> I2CDDCControl::ReadEDID(int fd) {
-  while (true) {
-    const int ret = ioctl(fd, I2C_SLAVE, kHostReadAddr);
-    if (ret != 0 && errno == EINTR) continue;
-    if (ret != 0)
-      return absl::ErrnoToStatus(
-          errno, absl::StrCat("failed to set I2C_SLAVE address 0x",
-                              absl::Hex(kHostReadAddr)));
-    break;
-  }
-  std::string buf(128, '0');
-  struct i2c_smbus_ioctl_data args;
-  memset(&args, 0, sizeof(args));
-  args.read_write = I2C_SMBUS_READ;
-  args.size = I2C_SMBUS_BYTE_DATA;
-  union i2c_smbus_data data;
-  args.data = &data;
-  for (size_t i = 0; i < buf.size(); i++) {
-    args.command = i;
-    while (true) {
-      const int ret = ioctl(fd, I2C_SMBUS, &args);
-      if (ret != 0 && errno == EINTR) continue;
-      if (ret != 0) return absl::ErrnoToStatus(errno, "SMBus read failed");
-      buf[i] = data.byte;
-      break;
-    }
-  }
-  return buf;
-}
 }  // namespace jjaro
@@ -3,44 +3,140 @@
 #include <absl/status/status.h>
 #include <absl/status/statusor.h>
 #include <absl/strings/string_view.h>
+#include <absl/time/time.h>
 #include <absl/types/span.h>
 
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 
 #include "control.h"
-#include "fd-holder.h"
+#include "ddc-pacer.h"
+#include "edid-cache.h"
+#include "i2c-transport.h"
 
 namespace jjaro {
 class I2CDDCControl : public Control {
  public:
+  static constexpr absl::string_view kBackend = "ddc-i2c";
   static absl::StatusOr<std::optional<I2CDDCControl>> Probe(
-      absl::string_view output, absl::string_view output_dir);
+      absl::string_view output, absl::string_view output_dir,
+      const ProbeContext &ctx);
   static absl::StatusOr<std::optional<I2CDDCControl>> ProbeDevice(
       absl::string_view output, absl::string_view device,
-      absl::string_view match_edid = "");
+      const ProbeContext &ctx, absl::string_view match_edid = "");
+  static absl::StatusOr<std::optional<I2CDDCControl>> ProbeCachedDevice(
+      absl::string_view output, absl::string_view output_dir,
+      absl::string_view device, int max_brightness,
+      absl::string_view sysfs_edid, const ProbeContext &ctx);
+  // Whether `device` is one of the connector's own buses, listed under
+  // `output_dir` or linked from it as `ddc`, rather than one that only the
+  // monitor's EDID ties to it.
+  static absl::StatusOr<bool> IsConnectorBus(absl::string_view output,
+                                             absl::string_view output_dir,
+                                             absl::string_view device);
+  // Learns the VCP maximum from `transport` before returning.
+  // `verify_every` is as `ProbeContext::ddc_verify_every`.  Without a
+  // `pacer`, the control gets one of its own.
+  static absl::StatusOr<I2CDDCControl> Create(
+      std::string name, std::unique_ptr<I2CTransport> transport,
+      int verify_every = 0, std::shared_ptr<DDCPacer> pacer = nullptr);
   I2CDDCControl(I2CDDCControl &&) = default;
   I2CDDCControl &operator=(I2CDDCControl &&) = default;
   ~I2CDDCControl() override = default;
+  int max_brightness() const { return max_brightness_; }
+  // How long Get VCP currently waits before reading the reply.
+  absl::Duration reply_delay() const { return reply_delay_; }
+  bool has_unverified_write() const override {
+    return unverified_value_.has_value();
+  }
+  absl::Time next_command_time() const override { return pacer_->ready_at(); }
+  absl::string_view backend() const override { return kBackend; }
+  // A Get or Set VCP command, as its errors start by naming it.  It's kept
+  // in pieces so that the name only gets built once something's gone wrong.
+  struct Command {
+    absl::string_view op;
+    std::byte code;
+    absl::string_view device;
+
+    std::string Describe() const;
+  };
+  // Checks a Get VCP Feature reply to `command`, naming it in any error.  A
+  // bad checksum is a DataLoss error.
+  static absl::Status ValidateGetVCPResp(absl::Span<const std::byte> buf,
+                                         const Command &command);
 
  private:
-  I2CDDCControl(std::string dev, FDHolder fd)
-      : Control(std::move(dev)), fd_(std::move(fd)) {}
-  absl::StatusOr<int> GetBrightnessPercentImpl(
+  I2CDDCControl(std::string dev, std::unique_ptr<I2CTransport> transport,
+                std::shared_ptr<DDCPacer> pacer, int verify_every,
+                int max_brightness = 0)
+      : Control(std::move(dev)),
+        transport_(std::move(transport)),
+        pacer_(std::move(pacer)),
+        verify_every_(verify_every),
+        max_brightness_(max_brightness) {
+    PublishReplyDelay();
+  }
+  // Returns null if `match_edid` is set and the monitor's doesn't match.
+  static absl::StatusOr<std::unique_ptr<I2CTransport>> OpenDevice(
+      absl::string_view output, absl::string_view device,
+      const ProbeContext &ctx, absl::string_view match_edid);
+  absl::StatusOr<int> GetRawBrightnessImpl(
       absl::FunctionRef<bool()> cancel) override;
-  absl::Status SetBrightnessPercentImpl(
-      int percent, absl::FunctionRef<bool()> cancel) override;
+  absl::Status SetRawBrightnessImpl(int raw,
+                                    absl::FunctionRef<bool()> cancel) override;
+  int max_raw_brightness() const override { return max_brightness_; }
+  absl::Status VerifyBrightnessImpl(absl::FunctionRef<bool()> cancel) override;
+  absl::StatusOr<VCPValue> GetVCPFeatureImpl(
+      uint8_t code, absl::FunctionRef<bool()> cancel) override;
+  absl::Status SetVCPFeatureImpl(uint8_t code, uint16_t value,
+                                 absl::FunctionRef<bool()> cancel) override;
+  // These go through `pacer_`, and the unpaced versions do the actual I/O.
+  absl::StatusOr<VCPValue> GetVCP(std::byte code,
+                                  absl::FunctionRef<bool()> cancel);
+  absl::Status SetVCP(std::byte code, uint16_t val,
+                      absl::FunctionRef<bool()> cancel);
+  absl::StatusOr<VCPValue> GetVCPUnpaced(std::byte code,
+                                         absl::FunctionRef<bool()> cancel,
+                                         int *retries);
+  absl::Status SetVCPUnpaced(std::byte code, uint16_t val,
+                             absl::FunctionRef<bool()> cancel, int *retries);
   absl::Status TryWrite(absl::Span<const std::byte> buf,
-                        absl::string_view error);
-  absl::Status TryRead(absl::Span<std::byte> buf, absl::string_view error);
-  static absl::Status ValidateBrightnessResp(absl::Span<const std::byte> buf,
-                                             absl::string_view error);
-  static absl::StatusOr<std::string> ReadEDID(int fd);
+                        const Command &command);
+  absl::Status TryRead(absl::Span<std::byte> buf, const Command &command);
+  // Records into both this control's stats and its bus's.
+  template <typename F>
+  void Record(F record) {
+    record(stats());
+    record(pacer_->stats());
+  }
+  void LearnReplyDelay(absl::Duration waited, bool first_read);
+  void SetReplyDelay(absl::Duration delay);
+  // Copies `reply_delay_` into `stats()` for `ddclight stats`.
+  void PublishReplyDelay() {
+    stats().reply_delay_us.store(absl::ToInt64Microseconds(reply_delay_),
+                                 std::memory_order_relaxed);
+  }
 
-  FDHolder fd_;
+  std::unique_ptr<I2CTransport> transport_;
+  std::shared_ptr<DDCPacer> pacer_;
+  int verify_every_;
   int max_brightness_;
+  // The last value written and not yet read back.
+  std::optional<uint16_t> unverified_value_;
+  // The last brightness read from the monitor, and whether it has ever read
+  // back a value it was set to as another one.
+  std::optional<uint16_t> last_read_;
+  bool rounds_ = false;
+  int writes_since_verify_ = 0;
+  // Starts at the 40ms the DDC/CI spec asks hosts to wait, and adapts to how
+  // quickly this monitor actually answers.
+  absl::Duration reply_delay_ = absl::Milliseconds(40);
+  int fast_replies_ = 0, fast_replies_needed_ = 8;
 };
 }  // namespace jjaro
 #endif  // JJARO_CONTROL_DDC_I2C_H_
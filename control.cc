@@ -1,27 +1,107 @@
 #include "control.h"
 
+#include <absl/status/status.h>
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
 #include <absl/strings/strip.h>
 #include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 
 #include <cstdint>
+#include <cstdio>
+#include <string>
 #include <utility>
 
 #include "control-backlight.h"
 #include "control-ddc-i2c.h"
 #include "deleter.h"
+#include "edid-cache.h"
+#include "edid.h"
+#include "misc.h"
+#include "probe-cache.h"
 
 namespace jjaro {
-absl::StatusOr<std::unique_ptr<Control>> Control::Probe(
-    const absl::string_view output) {
+namespace {
+absl::StatusOr<std::string> ReadSysfsEDID(const absl::string_view output_dir) {
+  const auto edid_fd = Open(absl::StrCat(output_dir, "/edid"), O_RDONLY);
+  if (!edid_fd.ok()) return edid_fd.status();
+  return ReadStr(edid_fd->get(), kEDIDMaxSize);
+}
+
+void Remember(const ProbeContext &ctx, const absl::string_view output,
+              const absl::string_view connector,
+              const absl::string_view backend, const absl::string_view device,
+              const int max_brightness) {
+  ProbeCache *const probe_cache = ctx.probe_cache;
+  if (!probe_cache) return;
+  const auto edid =
+      ReadSysfsEDID(absl::StrCat(ctx.root, "/sys/class/drm/", connector));
+  // Without an EDID there's nothing to check a cached entry against.
+  const auto us =
+      edid.ok()
+          ? probe_cache->Update(output,
+                                {.connector = std::string(connector),
+                                 .edid_hash = ProbeCache::HashEDID(*edid),
+                                 .backend = std::string(backend),
+                                 .device = std::string(device),
+                                 .max_brightness = max_brightness})
+          : probe_cache->Erase(output);
+#ifndef NDEBUG
+  if (!us.ok())
+    absl::FPrintF(stderr, "Failed to update probe cache for %s: %s\n", output,
+                  us.ToString());
+#endif
+}
+
+// Returns null on any kind of miss, and the caller falls back to a full probe.
+// An entry that no longer checks out is dropped, so one left behind by a
+// re-cabling isn't tried again on every start until a probe replaces it.
+std::unique_ptr<Control> ProbeCached(const absl::string_view output,
+                                     const ProbeContext &ctx) {
+  const auto entry = ctx.probe_cache->Lookup(output);
+  if (!entry) return nullptr;
+  const auto stale = [&]() -> std::unique_ptr<Control> {
+    const auto es = ctx.probe_cache->Erase(output);
+#ifndef NDEBUG
+    if (!es.ok())
+      absl::FPrintF(stderr, "Failed to drop probe cache entry for %s: %s\n",
+                    output, es.ToString());
+#endif
+    return nullptr;
+  };
+  const auto output_dir =
+      absl::StrCat(ctx.root, "/sys/class/drm/", entry->connector);
+  const auto edid = ReadSysfsEDID(output_dir);
+  if (!edid.ok() || ProbeCache::HashEDID(*edid) != entry->edid_hash)
+    return stale();
+  if (entry->backend == BacklightControl::kBackend) {
+    auto bl = BacklightControl::ProbeDevice(output, entry->device, ctx);
+    if (bl.ok() && *bl)
+      return std::make_unique<BacklightControl>(std::move(**bl));
+  } else if (entry->backend == I2CDDCControl::kBackend) {
+    auto ddc = I2CDDCControl::ProbeCachedDevice(output, output_dir,
+                                                entry->device,
+                                                entry->max_brightness, *edid,
+                                                ctx);
+    if (ddc.ok() && *ddc)
+      return std::make_unique<I2CDDCControl>(std::move(**ddc));
+  }
+  return stale();
+}
+
+// Finds the `card<N>-<output>` entry in /sys/class/drm.
+absl::StatusOr<std::string> FindConnector(const absl::string_view output,
+                                          const ProbeContext &ctx) {
+  const auto drm_path = absl::StrCat(ctx.root, "/sys/class/drm");
   std::unique_ptr<DIR, Deleter<closedir>> drm_dir;
   while (true) {
-    drm_dir.reset(opendir("/sys/class/drm"));
+    drm_dir.reset(opendir(drm_path.c_str()));
     if (!drm_dir && errno == EINTR) continue;
     if (!drm_dir)
-      return absl::ErrnoToStatus(errno, "opendir failed for /sys/class/drm");
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("opendir failed for ", drm_path));
     break;
   }
   while (true) {
@@ -29,7 +109,8 @@ absl::StatusOr<std::unique_ptr<Control>> Control::Probe(
     const struct dirent *const ent = readdir(drm_dir.get());
     if (!ent && errno == EINTR) continue;
     if (!ent && errno)
-      return absl::ErrnoToStatus(errno, "readdir failed for /sys/class/drm");
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("readdir failed for ", drm_path));
     if (!ent)
       return absl::NotFoundError(
           absl::StrCat("no drm output directory found for ", output));
@@ -40,20 +121,66 @@ absl::StatusOr<std::unique_ptr<Control>> Control::Probe(
     if (!absl::ConsumeSuffix(&ent_name, "-")) continue;
     uint64_t card_num;
     if (!absl::SimpleAtoi(ent_name, &card_num)) continue;
-    const auto output_dir = absl::StrCat("/sys/class/drm/", ent->d_name);
-    auto bl = BacklightControl::Probe(output, output_dir);
-    if (!bl.ok())
-      return absl::Status(bl.status().code(),
-                          absl::StrCat("failed to probe backlight control for ",
-                                       output, ": ", bl.status().message()));
-    if (*bl) return std::make_unique<BacklightControl>(std::move(**bl));
-    auto ddc = I2CDDCControl::Probe(output, output_dir);
-    if (!ddc.ok())
-      return absl::Status(ddc.status().code(),
-                          absl::StrCat("failed to probe DDC I2C control for ",
-                                       output, ": ", ddc.status().message()));
-    if (*ddc) return std::make_unique<I2CDDCControl>(std::move(**ddc));
-    return absl::NotFoundError(absl::StrCat("no control found for ", output));
+    return std::string(ent->d_name);
+  }
+}
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<Control>> Control::Probe(
+    const absl::string_view output, const ProbeContext &ctx) {
+  if (ctx.probe_cache)
+    if (auto ctrl = ProbeCached(output, ctx); ctrl) return ctrl;
+  const auto connector = FindConnector(output, ctx);
+  if (!connector.ok()) return connector.status();
+  const auto output_dir = absl::StrCat(ctx.root, "/sys/class/drm/", *connector);
+  auto bl = BacklightControl::Probe(output, output_dir, ctx);
+  if (!bl.ok())
+    return absl::Status(bl.status().code(),
+                        absl::StrCat("failed to probe backlight control for ",
+                                     output, ": ", bl.status().message()));
+  if (*bl) {
+    Remember(ctx, output, *connector, BacklightControl::kBackend,
+             (*bl)->name(), 0);
+    return std::make_unique<BacklightControl>(std::move(**bl));
+  }
+  auto ddc = I2CDDCControl::Probe(output, output_dir, ctx);
+  if (!ddc.ok())
+    return absl::Status(ddc.status().code(),
+                        absl::StrCat("failed to probe DDC I2C control for ",
+                                     output, ": ", ddc.status().message()));
+  if (*ddc) {
+    Remember(ctx, output, *connector, I2CDDCControl::kBackend,
+             (*ddc)->name(), (*ddc)->max_brightness());
+    return std::make_unique<I2CDDCControl>(std::move(**ddc));
+  }
+  return absl::NotFoundError(absl::StrCat("no control found for ", output));
+}
+
+absl::StatusOr<std::unique_ptr<Control>> Control::ProbeI2CDevice(
+    const absl::string_view output, const absl::string_view device,
+    const ProbeContext &ctx) {
+  const auto connector = FindConnector(output, ctx);
+  if (!connector.ok()) return connector.status();
+  const auto output_dir = absl::StrCat(ctx.root, "/sys/class/drm/", *connector);
+  const auto own = I2CDDCControl::IsConnectorBus(output, output_dir, device);
+  if (!own.ok()) return own.status();
+  std::string match_edid;
+  if (!*own) {
+    auto edid = ReadSysfsEDID(output_dir);
+    if (!edid.ok())
+      return absl::Status(
+          edid.status().code(),
+          absl::StrCat(output, " could not read EDID from sysfs: ",
+                       edid.status().message()));
+    match_edid = *std::move(edid);
   }
+  auto ddc = I2CDDCControl::ProbeDevice(output, device, ctx, match_edid);
+  if (!ddc.ok()) return ddc.status();
+  if (!*ddc)
+    return absl::NotFoundError(
+        absl::StrCat("no control found for ", output, " on ", device));
+  Remember(ctx, output, *connector, I2CDDCControl::kBackend, (*ddc)->name(),
+           (*ddc)->max_brightness());
+  return std::make_unique<I2CDDCControl>(std::move(**ddc));
 }
 }  // namespace jjaro
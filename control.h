@@ -3,52 +3,212 @@
 #include <absl/functional/function_ref.h>
 #include <absl/status/status.h>
 #include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/string_view.h>
+#include <absl/time/time.h>
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <string>
 
+#include "brightness.h"
+#include "stats.h"
+
 namespace jjaro {
+class DDCPacers;
+class EDIDCache;
+class I2CBusOpener;
+class ProbeCache;
+
+// Everything a probe needs besides the output name.
+struct ProbeContext {
+  // Prefixed to every sysfs and devfs path, so probes can run against a
+  // synthetic tree.  Empty means the real root.
+  std::string root;
+  // May be shared by concurrent probes in the same pass.
+  EDIDCache *edid_cache = nullptr;
+  // If set, tried before anything else and updated after a full probe.
+  ProbeCache *probe_cache = nullptr;
+  // If set, I2C buses are opened through this rather than `root`'s `/dev`,
+  // and their device numbers are only taken from sysfs.
+  I2CBusOpener *i2c_opener = nullptr;
+  // DDC/CI controls read back every this many writes to check they took.
+  // Zero leaves it to `Control::VerifyBrightness` when the bus is idle.
+  int ddc_verify_every = 0;
+  // If set, DDC/CI controls on the same bus share a pacer from here.
+  DDCPacers *ddc_pacers = nullptr;
+};
+
+// A VCP feature's value, and the most it can be, as a monitor reports them.
+struct VCPValue {
+  uint16_t value, max;
+};
+
 class Control {
  public:
   static absl::StatusOr<std::unique_ptr<Control>> Probe(
-      absl::string_view output);
+      absl::string_view output, const ProbeContext &ctx);
+  // Probes only the I2C bus `device` for a DDC/CI control for `output`, as
+  // when the bus turns up after the output did.  Buses that aren't the
+  // connector's own have to have a monitor with the connector's EDID.
+  static absl::StatusOr<std::unique_ptr<Control>> ProbeI2CDevice(
+      absl::string_view output, absl::string_view device,
+      const ProbeContext &ctx);
   virtual ~Control() = default;
-  absl::StatusOr<int> GetBrightnessPercent(absl::FunctionRef<bool()> cancel =
-                                               [] { return false; }) {
-    auto ret = GetBrightnessPercentImpl(cancel);
-    if (ret.ok()) cached_brightness_percent_ = *ret;
-    return ret;
+  // Brightness levels are as in brightness.h.
+  absl::StatusOr<int> GetBrightnessLevel(
+      absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    const int max_raw = max_raw_brightness();
+    auto raw = GetRawBrightnessImpl(cancel);
+    if (!raw.ok()) return raw.status();
+    // Not every level survives the trip through a raw range that doesn't
+    // divide evenly, so a device still where it was left keeps the level it
+    // was set to rather than the one its raw value rounds back to.
+    if (*raw != cached_raw_brightness_ || max_raw != max_raw_brightness() ||
+        !cached_brightness_level_) {
+      cached_brightness_level_ = LevelFromRaw(*raw, max_raw_brightness());
+      written_raw_brightness_.reset();
+    }
+    cached_raw_brightness_ = *raw;
+    return *cached_brightness_level_;
+  }
+  // Levels that map to the raw value already there don't touch the device,
+  // so a fade only costs as many writes as the device has steps.
+  absl::Status SetBrightnessLevel(
+      int level, absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    const int raw = RawFromLevel(level, max_raw_brightness());
+    if (!IsCurrentRaw(raw)) {
+      // A failed write may have landed anyway, so nothing's skipped until
+      // one works.
+      cached_raw_brightness_.reset();
+      written_raw_brightness_.reset();
+      if (auto ss = SetRawBrightnessImpl(raw, cancel); !ss.ok()) return ss;
+      if (!written_raw_brightness_) cached_raw_brightness_ = raw;
+    }
+    cached_brightness_level_ = level;
+    return absl::OkStatus();
+  }
+  // Reads the brightness back, and returns whether something else has moved
+  // it since this control last read or set it.  A device holding what it
+  // read back as after the last write, rounding and all, hasn't moved.
+  absl::StatusOr<bool> ReadBackMoved(
+      absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    const auto before = cached_brightness_level();
+    if (!before.ok()) return before.status();
+    if (auto level = GetBrightnessLevel(cancel); !level.ok())
+      return level.status();
+    return !IsCurrentLevel(*before);
+  }
+  absl::StatusOr<int> GetBrightnessPercent(
+      absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    auto ret = GetBrightnessLevel(cancel);
+    if (!ret.ok()) return ret.status();
+    return PercentFromLevel(*ret);
   }
   absl::Status SetBrightnessPercent(
       int percent, absl::FunctionRef<bool()> cancel = [] { return false; }) {
-    auto ret = SetBrightnessPercentImpl(percent, cancel);
-    if (ret.ok()) cached_brightness_percent_ = percent;
+    return SetBrightnessLevel(LevelFromPercent(percent), cancel);
+  }
+  // Reads back what the last `SetBrightnessLevel` wrote, and reissues it if
+  // it didn't take.  Only controls that skip that read after writing have
+  // anything to do here.
+  absl::Status VerifyBrightness(
+      absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    auto ret = VerifyBrightnessImpl(cancel);
+    // Whatever's there now, the next set shouldn't be skipped for it.
+    if (!ret.ok()) {
+      cached_raw_brightness_.reset();
+      written_raw_brightness_.reset();
+    }
     return ret;
   }
-  absl::StatusOr<int> cached_brightness_percent() const {
-    if (!cached_brightness_percent_)
+  virtual bool has_unverified_write() const { return false; }
+  // Whether the device says when its brightness changes, for
+  // `WaitForChange`.
+  virtual bool reports_changes() const { return false; }
+  // Blocks until the device reports a change of brightness, made here or
+  // elsewhere, or until `stop_fd` is readable, when it returns
+  // `absl::CancelledError`.  Safe to call alongside the other methods.
+  virtual absl::Status WaitForChange(int stop_fd) {
+    return absl::UnimplementedError(
+        absl::StrCat(name(), " doesn't report changes"));
+  }
+  // The earliest a command sent now would actually go out.  Waiting until
+  // then before picking what to send lets a burst of targets collapse into
+  // the newest.
+  virtual absl::Time next_command_time() const { return absl::InfinitePast(); }
+  // Raw DDC/CI VCP features, for controls that speak it.  Brightness is
+  // better left to the percentage calls, which keep track of it.
+  absl::StatusOr<VCPValue> GetVCPFeature(
+      uint8_t code, absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    return GetVCPFeatureImpl(code, cancel);
+  }
+  absl::Status SetVCPFeature(
+      uint8_t code, uint16_t value,
+      absl::FunctionRef<bool()> cancel = [] { return false; }) {
+    return SetVCPFeatureImpl(code, value, cancel);
+  }
+  // Whether `SetBrightnessLevel(level)` would leave the device as it is.
+  bool IsCurrentLevel(int level) const {
+    return IsCurrentRaw(RawFromLevel(level, max_raw_brightness()));
+  }
+  absl::StatusOr<int> cached_brightness_level() const {
+    if (!cached_brightness_level_)
       return absl::FailedPreconditionError("uninitialized brightness");
-    return *cached_brightness_percent_;
+    return *cached_brightness_level_;
   }
   absl::string_view name() const { return name_; }
+  // Which kind of control this is, as the probe cache records it.
+  virtual absl::string_view backend() const = 0;
+  TransportStats &stats() const { return *stats_; }
 
  protected:
   Control(absl::string_view name) : name_(name) {}
-  Control(const Control &) = default;
   Control(Control &&) = default;
-  Control &operator=(const Control &) = default;
   Control &operator=(Control &&) = default;
+  // For controls that read back what they write: the device was set to raw
+  // value `written` and reads back as `raw`, having rounded it.  Neither is
+  // then taken for a change made elsewhere, nor written again.
+  void ReadBack(int written, int raw) {
+    cached_raw_brightness_ = raw;
+    if (raw != written) {
+      written_raw_brightness_ = written;
+    } else {
+      written_raw_brightness_.reset();
+    }
+  }
 
  private:
-  virtual absl::StatusOr<int> GetBrightnessPercentImpl(
+  bool IsCurrentRaw(int raw) const {
+    return raw == cached_raw_brightness_ || raw == written_raw_brightness_;
+  }
+  // Raw values run from 0 to `max_raw_brightness()`, which a read may update.
+  virtual absl::StatusOr<int> GetRawBrightnessImpl(
       absl::FunctionRef<bool()> cancel) = 0;
-  virtual absl::Status SetBrightnessPercentImpl(
-      int percent, absl::FunctionRef<bool()> cancel) = 0;
+  virtual absl::Status SetRawBrightnessImpl(
+      int raw, absl::FunctionRef<bool()> cancel) = 0;
+  virtual int max_raw_brightness() const = 0;
+  virtual absl::Status VerifyBrightnessImpl(absl::FunctionRef<bool()> cancel) {
+    return absl::OkStatus();
+  }
+  virtual absl::StatusOr<VCPValue> GetVCPFeatureImpl(
+      uint8_t code, absl::FunctionRef<bool()> cancel) {
+    return absl::UnimplementedError(
+        absl::StrCat(name_, " has no VCP features"));
+  }
+  virtual absl::Status SetVCPFeatureImpl(uint8_t code, uint16_t value,
+                                         absl::FunctionRef<bool()> cancel) {
+    return absl::UnimplementedError(
+        absl::StrCat(name_, " has no VCP features"));
+  }
 
   std::string name_;
-  std::optional<int> cached_brightness_percent_;
+  std::optional<int> cached_brightness_level_, cached_raw_brightness_;
+  // What was written to get `cached_raw_brightness_`, where the device
+  // rounded it to that.
+  std::optional<int> written_raw_brightness_;
+  std::unique_ptr<TransportStats> stats_ = std::make_unique<TransportStats>();
 };
 }  // namespace jjaro
 #endif  // JJARO_CONTROL_H_
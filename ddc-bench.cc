@@ -0,0 +1,190 @@
+// DDC/CI Get and Set against an emulated monitor, across bus fault rates.
+// Besides time, each benchmark reports the emulator's view of the traffic
+// per iteration, so retries and their causes show up directly.
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "control-ddc-i2c.h"
+#include "ddc-ci.h"
+#include "ddc-emulator.h"
+#include "ddc-pacer.h"
+
+namespace jjaro {
+namespace {
+// Fault rates are passed in per mille, since benchmark ranges are integers.
+EmulatedMonitorOptions Options(const benchmark::State &state) {
+  return {.reply_latency = absl::ZeroDuration(),
+          .nak_rate = state.range(0) / 1000.0,
+          .corruption_rate = state.range(1) / 1000.0};
+}
+
+// None of these monitors need a gap between commands, so leave it out of the
+// timings unless it's what's being measured.
+std::shared_ptr<DDCPacer> Unpaced() {
+  return std::make_shared<DDCPacer>(absl::ZeroDuration());
+}
+
+void ReportCounters(benchmark::State &state,
+                    const EmulatedDDCMonitor::Counters &counters) {
+  const auto rate = benchmark::Counter::kAvgIterations;
+  state.counters["writes"] = benchmark::Counter(counters.writes, rate);
+  state.counters["reads"] = benchmark::Counter(counters.reads, rate);
+  state.counters["naks"] = benchmark::Counter(counters.naks, rate);
+  state.counters["corruptions"] =
+      benchmark::Counter(counters.corruptions, rate);
+}
+
+void BM_DDCGet(benchmark::State &state) {
+  EmulatedDDCMonitor monitor("", Options(state));
+  auto control =
+      I2CDDCControl::Create("emulated", monitor.Connect(), 0, Unpaced());
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int64_t failures = 0;
+  for (auto _ : state) {
+    auto percent = control->GetBrightnessPercent([] { return false; });
+    if (!percent.ok()) {
+      failures++;
+    } else if (*percent != 50) {
+      state.SkipWithError(absl::StrCat("read ", *percent, "%").c_str());
+      return;
+    }
+  }
+  ReportCounters(state, monitor.counters());
+  state.counters["failures"] =
+      benchmark::Counter(failures, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DDCGet)
+    ->ArgNames({"nak_permille", "corrupt_permille"})
+    ->ArgsProduct({{0, 10, 100}, {0, 10, 100}})
+    ->Unit(benchmark::kMillisecond);
+
+// Sets against a monitor that sometimes drops them, read back every
+// `verify_every` writes.  With read-back on every write, all of them must
+// land; otherwise this shows what skipping the reads saves.
+void BM_DDCSet(benchmark::State &state) {
+  const int verify_every = state.range(2);
+  EmulatedDDCMonitor monitor("", {.reply_latency = absl::ZeroDuration(),
+                                  .nak_rate = state.range(0) / 1000.0,
+                                  .dropped_set_rate = state.range(1) / 1000.0});
+  auto control = I2CDDCControl::Create("emulated", monitor.Connect(),
+                                       verify_every, Unpaced());
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int percent = 0, failures = 0;
+  for (auto _ : state) {
+    percent = (percent + 37) % 101;
+    if (!control->SetBrightnessPercent(percent, [] { return false; }).ok()) {
+      failures++;
+      continue;
+    }
+    if (verify_every == 1 &&
+        monitor.GetFeature(static_cast<uint8_t>(ddc::kVCPBrightness)) !=
+            percent) {
+      state.SkipWithError(
+          absl::StrCat("set ", percent, "% didn't stick").c_str());
+      return;
+    }
+  }
+  const auto counters = monitor.counters();
+  ReportCounters(state, counters);
+  state.counters["dropped_sets"] = benchmark::Counter(
+      counters.dropped_sets, benchmark::Counter::kAvgIterations);
+  state.counters["failures"] =
+      benchmark::Counter(failures, benchmark::Counter::kAvgIterations);
+}
+BENCHMARK(BM_DDCSet)
+    ->ArgNames({"nak_permille", "drop_permille", "verify_every"})
+    ->ArgsProduct({{0, 100}, {0, 100}, {0, 1, 8}});
+// Back-to-back Sets, as under key repeat, against a monitor that NAKs
+// commands arriving within 10ms of its last transaction.  A pacer gap of zero
+// is the unpaced behaviour.
+void BM_DDCSetThroughput(benchmark::State &state) {
+  constexpr absl::Duration kMonitorGap = absl::Milliseconds(10);
+  EmulatedDDCMonitor monitor("", {.reply_latency = absl::ZeroDuration(),
+                                  .command_gap = kMonitorGap});
+  auto control = I2CDDCControl::Create(
+      "emulated", monitor.Connect(), 0,
+      std::make_shared<DDCPacer>(absl::Milliseconds(state.range(0))));
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int percent = 0;
+  int64_t sets = 0;
+  for (auto _ : state) {
+    percent = (percent + 37) % 101;
+    if (control->SetBrightnessPercent(percent, [] { return false; }).ok())
+      sets++;
+  }
+  ReportCounters(state, monitor.counters());
+  state.counters["sets_per_second"] =
+      benchmark::Counter(sets, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_DDCSetThroughput)
+    ->ArgName("pacer_gap_ms")
+    ->Arg(0)
+    ->Arg(10)
+    ->Iterations(50)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+// Brightness and volume changes interleaved on one monitor, as from a
+// brightness key and a volume script at once.  Either one control owns the
+// bus and paces both features, or each feature has its own control and
+// pacer, as separate tools reopening the bus would.
+void BM_DDCMixedFeatures(benchmark::State &state) {
+  constexpr absl::Duration kGap = absl::Milliseconds(10);
+  constexpr uint8_t kVCPAudioVolume = 0x62;
+  const bool shared = state.range(0);
+  EmulatedDDCMonitor monitor("", {.reply_latency = absl::ZeroDuration(),
+                                  .command_gap = kGap});
+  monitor.SetFeature(kVCPAudioVolume, 50, 100);
+  auto pacer = std::make_shared<DDCPacer>(kGap);
+  auto brightness =
+      I2CDDCControl::Create("emulated", monitor.Connect(), 0, pacer);
+  absl::SleepFor(kGap);
+  auto volume = I2CDDCControl::Create(
+      "emulated", monitor.Connect(), 0,
+      shared ? pacer : std::make_shared<DDCPacer>(kGap));
+  if (!brightness.ok() || !volume.ok()) {
+    state.SkipWithError("couldn't create controls");
+    return;
+  }
+  int value = 0;
+  std::atomic<int64_t> sets = 0;
+  for (auto _ : state) {
+    value = (value + 37) % 101;
+    std::thread volume_thread([&] {
+      if (volume->SetVCPFeature(kVCPAudioVolume, value).ok()) sets++;
+    });
+    const bool ok = brightness->SetBrightnessPercent(value).ok();
+    volume_thread.join();
+    if (ok) sets++;
+  }
+  ReportCounters(state, monitor.counters());
+  state.counters["sets_per_second"] =
+      benchmark::Counter(sets.load(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_DDCMixedFeatures)
+    ->ArgName("shared_pacer")
+    ->Arg(0)
+    ->Arg(1)
+    ->Iterations(50)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}  // namespace
+}  // namespace jjaro
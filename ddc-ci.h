@@ -0,0 +1,51 @@
+#ifndef JJARO_DDC_CI_H_
+#define JJARO_DDC_CI_H_ 1
+#include <absl/types/span.h>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// DDC/CI wire format constants, shared by the control and the emulator.
+namespace jjaro::ddc {
+constexpr std::byte kDeviceWriteAddr{0x6e};
+constexpr std::byte kHostWriteAddr{0x51};
+constexpr std::byte kHostReadAddr{0x50};
+constexpr std::byte LengthByte(size_t sz) {
+  return static_cast<std::byte>(0x80 + sz);
+}
+constexpr size_t LengthOf(std::byte b) {
+  return static_cast<size_t>(b & std::byte{0x7f});
+}
+constexpr std::byte kOpCodeGetVCPReq{0x01};
+constexpr std::byte kOpCodeGetVCPResp{0x02};
+constexpr std::byte kOpCodeSetVCPReq{0x03};
+constexpr std::byte kVCPBrightness{0x10};
+constexpr std::byte Checksum(absl::Span<const std::byte> buf) {
+  std::byte cksum{0};
+  for (std::byte b : buf) cksum ^= b;
+  return cksum;
+}
+// Requests start with the address they're for, which goes into the checksum
+// but not over the wire, where the bus carries it instead.
+constexpr std::array<std::byte, 6> GetVCPRequest(std::byte code) {
+  std::array<std::byte, 6> req{kDeviceWriteAddr, kHostWriteAddr,
+                               LengthByte(2),    kOpCodeGetVCPReq,
+                               code,             std::byte{0}};
+  req.back() = Checksum(req);
+  return req;
+}
+constexpr std::array<std::byte, 8> SetVCPRequest(std::byte code,
+                                                 uint16_t val) {
+  std::array<std::byte, 8> req{kDeviceWriteAddr,
+                               kHostWriteAddr,
+                               LengthByte(4),
+                               kOpCodeSetVCPReq,
+                               code,
+                               static_cast<std::byte>(val >> 8),
+                               static_cast<std::byte>(val)};
+  req.back() = Checksum(req);
+  return req;
+}
+}  // namespace jjaro::ddc
+#endif  // JJARO_DDC_CI_H_
@@ -0,0 +1,205 @@
+#include "ddc-emulator.h"
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <absl/types/span.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "ddc-ci.h"
+#include "i2c-transport.h"
+
+namespace jjaro {
+namespace {
+class EmulatedTransport : public I2CTransport {
+ public:
+  explicit EmulatedTransport(EmulatedDDCMonitor *monitor)
+      : monitor_(monitor) {}
+  absl::Status Write(absl::Span<const std::byte> buf) override {
+    return monitor_->Write(buf);
+  }
+  absl::Status Read(absl::Span<std::byte> buf) override {
+    return monitor_->Read(buf);
+  }
+  absl::StatusOr<std::string> ReadEDID() override {
+    return monitor_->ReadEDID();
+  }
+
+ private:
+  EmulatedDDCMonitor *const monitor_;
+};
+
+uint16_t Word(std::byte hi, std::byte lo) {
+  return static_cast<uint16_t>(hi) << 8 | static_cast<uint16_t>(lo);
+}
+}  // namespace
+
+EmulatedDDCMonitor::EmulatedDDCMonitor(std::string edid,
+                                       EmulatedMonitorOptions options)
+    : edid_(std::move(edid)), options_(options), rng_(options.seed) {
+  features_.emplace(static_cast<uint8_t>(ddc::kVCPBrightness),
+                    Feature{50, 100});
+}
+
+void EmulatedDDCMonitor::SetFeature(uint8_t code, uint16_t value,
+                                    uint16_t max) {
+  absl::MutexLock l(&lock_);
+  features_.insert_or_assign(code, Feature{value, max});
+}
+
+std::optional<uint16_t> EmulatedDDCMonitor::GetFeature(uint8_t code) const {
+  absl::MutexLock l(&lock_);
+  const auto it = features_.find(code);
+  if (it == features_.end()) return std::nullopt;
+  return it->second.value;
+}
+
+EmulatedDDCMonitor::Counters EmulatedDDCMonitor::counters() const {
+  absl::MutexLock l(&lock_);
+  return counters_;
+}
+
+std::unique_ptr<I2CTransport> EmulatedDDCMonitor::Connect() {
+  return std::make_unique<EmulatedTransport>(this);
+}
+
+bool EmulatedDDCMonitor::Roll(double rate) {
+  return rate > 0 && std::uniform_real_distribution<>()(rng_) < rate;
+}
+
+// The bus is held for the whole transfer, so this sleeps with the lock held.
+absl::Status EmulatedDDCMonitor::Transact(size_t bytes, bool command) {
+  if (options_.byte_time > absl::ZeroDuration())
+    absl::SleepFor(options_.byte_time * static_cast<int64_t>(bytes));
+  const absl::Time now = absl::Now();
+  const bool early =
+      command && now - last_transaction_ < options_.command_gap;
+  last_transaction_ = now;
+  if (early || Roll(options_.nak_rate)) {
+    counters_.naks++;
+    return absl::ErrnoToStatus(ENXIO, "NAK");
+  }
+  return absl::OkStatus();
+}
+
+// `buf` starts with our source address, as on the wire after the destination
+// address byte the adapter sends for us.
+absl::Status EmulatedDDCMonitor::Write(absl::Span<const std::byte> buf) {
+  absl::MutexLock l(&lock_);
+  counters_.writes++;
+  if (auto ts = Transact(buf.size(), true); !ts.ok()) return ts;
+  // Monitors silently drop malformed requests, so none of these are errors.
+  std::byte cksum = ddc::Checksum(buf) ^ ddc::kDeviceWriteAddr;
+  if (buf.size() < 3 || buf[0] != ddc::kHostWriteAddr ||
+      ddc::LengthOf(buf[1]) + 3 != buf.size() || cksum != std::byte{0}) {
+    counters_.bad_requests++;
+    return absl::OkStatus();
+  }
+  reply_.clear();
+  const auto payload = buf.subspan(2, ddc::LengthOf(buf[1]));
+  if (payload.size() == 2 && payload[0] == ddc::kOpCodeGetVCPReq) {
+    counters_.gets++;
+    const auto code = static_cast<uint8_t>(payload[1]);
+    const auto it = features_.find(code);
+    const Feature feature =
+        it == features_.end() ? Feature{0, 0} : it->second;
+    reply_ = {ddc::kDeviceWriteAddr,
+              ddc::LengthByte(8),
+              ddc::kOpCodeGetVCPResp,
+              std::byte{it == features_.end()},
+              payload[1],
+              std::byte{0},
+              static_cast<std::byte>(feature.max >> 8),
+              static_cast<std::byte>(feature.max),
+              static_cast<std::byte>(feature.value >> 8),
+              static_cast<std::byte>(feature.value)};
+    reply_.push_back(ddc::kHostReadAddr ^ ddc::Checksum(reply_));
+    reply_ready_ = absl::Now() + options_.reply_latency;
+  } else if (payload.size() == 4 && payload[0] == ddc::kOpCodeSetVCPReq) {
+    counters_.sets++;
+    const auto it = features_.find(static_cast<uint8_t>(payload[1]));
+    if (Roll(options_.dropped_set_rate)) {
+      counters_.dropped_sets++;
+    } else if (it != features_.end()) {
+      uint16_t value = std::min(Word(payload[2], payload[3]), it->second.max);
+      if (payload[1] == ddc::kVCPBrightness)
+        value -= value % options_.brightness_step;
+      it->second.value = value;
+    }
+  } else {
+    counters_.bad_requests++;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status EmulatedDDCMonitor::Read(absl::Span<std::byte> buf) {
+  absl::MutexLock l(&lock_);
+  counters_.reads++;
+  if (auto ts = Transact(buf.size(), false); !ts.ok()) return ts;
+  std::fill(buf.begin(), buf.end(), std::byte{0});
+  if (reply_.empty() || absl::Now() < reply_ready_) {
+    counters_.null_replies++;
+    constexpr std::byte kNullMessage[] = {
+        ddc::kDeviceWriteAddr, ddc::LengthByte(0),
+        ddc::kHostReadAddr ^ ddc::kDeviceWriteAddr ^ ddc::LengthByte(0)};
+    std::copy_n(kNullMessage, std::min(buf.size(), std::size(kNullMessage)),
+                buf.begin());
+    return absl::OkStatus();
+  }
+  // Like most monitors, repeat the reply until the next request, so a host
+  // can re-read after a corrupt transfer.
+  std::copy_n(reply_.begin(), std::min(buf.size(), reply_.size()),
+              buf.begin());
+  if (!buf.empty() && Roll(options_.corruption_rate)) {
+    counters_.corruptions++;
+    const size_t bit =
+        std::uniform_int_distribution<size_t>(0, buf.size() * 8 - 1)(rng_);
+    buf[bit / 8] ^= static_cast<std::byte>(1 << (bit % 8));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> EmulatedDDCMonitor::ReadEDID() {
+  absl::MutexLock l(&lock_);
+  counters_.edid_reads++;
+  if (auto ts = Transact(edid_.size(), false); !ts.ok()) return ts;
+  return edid_;
+}
+
+EmulatedDDCMonitor &EmulatedI2CBuses::Add(std::string device,
+                                          std::string edid,
+                                          EmulatedMonitorOptions options) {
+  auto monitor =
+      std::make_unique<EmulatedDDCMonitor>(std::move(edid), options);
+  EmulatedDDCMonitor &ret = *monitor;
+  monitors_.insert_or_assign(std::move(device), std::move(monitor));
+  return ret;
+}
+
+EmulatedDDCMonitor *EmulatedI2CBuses::Find(absl::string_view device) {
+  const auto it = monitors_.find(device);
+  return it == monitors_.end() ? nullptr : it->second.get();
+}
+
+absl::StatusOr<std::unique_ptr<I2CTransport>> EmulatedI2CBuses::Open(
+    absl::string_view device) {
+  EmulatedDDCMonitor *const monitor = Find(device);
+  if (!monitor)
+    return absl::NotFoundError(absl::StrCat("no emulated monitor on ", device));
+  return monitor->Connect();
+}
+}  // namespace jjaro
@@ -0,0 +1,105 @@
+#ifndef JJARO_DDC_EMULATOR_H_
+#define JJARO_DDC_EMULATOR_H_ 1
+#include <absl/base/thread_annotations.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+#include <absl/types/span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "i2c-transport.h"
+
+namespace jjaro {
+struct EmulatedMonitorOptions {
+  // How long after a Get VCP request the reply is ready.  Reading sooner gets
+  // a DDC/CI null message, as it would from a real monitor.
+  absl::Duration reply_latency = absl::Milliseconds(40);
+  // Commands sooner than this after the previous transaction are NAKed.
+  absl::Duration command_gap = absl::ZeroDuration();
+  // Bus time per byte transferred; 90us is about what 100kHz gives.
+  absl::Duration byte_time = absl::ZeroDuration();
+  // The chance any one transaction is NAKed.
+  double nak_rate = 0;
+  // The chance a reply comes back with one bit flipped.
+  double corruption_rate = 0;
+  // The chance a well-formed Set VCP is acknowledged but ignored.
+  double dropped_set_rate = 0;
+  // Brightness is set to the multiple of this at or below what's asked, as
+  // on monitors with fewer steps than they claim.
+  uint16_t brightness_step = 1;
+  uint32_t seed = 1;
+};
+
+// A DDC/CI monitor in memory: Get and Set VCP with checksums on 0x37, plus an
+// EDID on 0x50, with configurable timing and faults.  It starts out with a
+// brightness (0x10) of 50 out of 100.
+class EmulatedDDCMonitor {
+ public:
+  struct Counters {
+    int64_t writes = 0, reads = 0, edid_reads = 0;
+    int64_t naks = 0, corruptions = 0, null_replies = 0, bad_requests = 0;
+    int64_t gets = 0, sets = 0, dropped_sets = 0;
+  };
+
+  explicit EmulatedDDCMonitor(std::string edid,
+                              EmulatedMonitorOptions options = {});
+  EmulatedDDCMonitor(const EmulatedDDCMonitor &) = delete;
+  EmulatedDDCMonitor &operator=(const EmulatedDDCMonitor &) = delete;
+
+  void SetFeature(uint8_t code, uint16_t value, uint16_t max);
+  std::optional<uint16_t> GetFeature(uint8_t code) const;
+  Counters counters() const;
+
+  // The returned transport must not outlive this.
+  std::unique_ptr<I2CTransport> Connect();
+
+  absl::Status Write(absl::Span<const std::byte> buf);
+  absl::Status Read(absl::Span<std::byte> buf);
+  absl::StatusOr<std::string> ReadEDID();
+
+ private:
+  struct Feature {
+    uint16_t value, max;
+  };
+  // Sleeps for the bus time and rolls for a NAK.
+  absl::Status Transact(size_t bytes, bool command)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  bool Roll(double rate) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  const std::string edid_;
+  const EmulatedMonitorOptions options_;
+  mutable absl::Mutex lock_;
+  std::map<uint8_t, Feature> features_ ABSL_GUARDED_BY(lock_);
+  std::vector<std::byte> reply_ ABSL_GUARDED_BY(lock_);
+  absl::Time reply_ready_ ABSL_GUARDED_BY(lock_);
+  absl::Time last_transaction_ ABSL_GUARDED_BY(lock_) = absl::InfinitePast();
+  std::mt19937 rng_ ABSL_GUARDED_BY(lock_);
+  Counters counters_ ABSL_GUARDED_BY(lock_);
+};
+
+// Serves emulated monitors as `i2c-*` buses, for `ProbeContext::i2c_opener`.
+class EmulatedI2CBuses : public I2CBusOpener {
+ public:
+  EmulatedDDCMonitor &Add(std::string device, std::string edid,
+                          EmulatedMonitorOptions options = {});
+  EmulatedDDCMonitor *Find(absl::string_view device);
+  absl::StatusOr<std::unique_ptr<I2CTransport>> Open(
+      absl::string_view device) override;
+
+ private:
+  std::map<std::string, std::unique_ptr<EmulatedDDCMonitor>, std::less<>>
+      monitors_;
+};
+}  // namespace jjaro
+#endif  // JJARO_DDC_EMULATOR_H_
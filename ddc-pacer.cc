@@ -0,0 +1,69 @@
+#include "ddc-pacer.h"
+
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace jjaro {
+absl::Time DDCPacer::ready_at() const {
+  absl::MutexLock l(&lock_);
+  return last_end_ + gap_;
+}
+
+void DDCPacer::Acquire() {
+  absl::Duration wait;
+  {
+    absl::MutexLock l(&lock_);
+    auto cond = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+      return !busy_;
+    };
+    lock_.Await(absl::Condition(&cond));
+    busy_ = true;
+    wait = std::max(last_end_ + gap_ - absl::Now(), absl::ZeroDuration());
+    wait_ = wait;
+  }
+  // Nobody else starts a transaction while we're busy, so the gap can only
+  // have grown since.
+  absl::SleepFor(wait);
+}
+
+void DDCPacer::Release() {
+  absl::MutexLock l(&lock_);
+  last_end_ = absl::Now();
+  paced_ += wait_;
+  busy_ = false;
+}
+
+absl::Duration DDCPacer::paced() const {
+  absl::MutexLock l(&lock_);
+  return paced_;
+}
+
+std::shared_ptr<DDCPacer> DDCPacers::Get(const absl::string_view device) {
+  absl::MutexLock l(&lock_);
+  auto it = pacers_.find(device);
+  if (it == pacers_.end())
+    it = pacers_.emplace(std::string(device), std::weak_ptr<DDCPacer>())
+             .first;
+  if (auto pacer = it->second.lock()) return pacer;
+  auto pacer = std::make_shared<DDCPacer>(gap_);
+  it->second = pacer;
+  return pacer;
+}
+
+std::vector<std::pair<std::string, std::shared_ptr<DDCPacer>>>
+DDCPacers::All() {
+  absl::MutexLock l(&lock_);
+  std::vector<std::pair<std::string, std::shared_ptr<DDCPacer>>> ret;
+  for (const auto &[device, weak] : pacers_)
+    if (auto pacer = weak.lock()) ret.emplace_back(device, std::move(pacer));
+  return ret;
+}
+}  // namespace jjaro
@@ -0,0 +1,86 @@
+#ifndef JJARO_DDC_PACER_H_
+#define JJARO_DDC_PACER_H_ 1
+#include <absl/base/thread_annotations.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "stats.h"
+
+namespace jjaro {
+// Spaces out DDC/CI transactions on one bus.  A monitor needs time after each
+// command before it will take another, and one sent sooner gets NAKed or,
+// worse, silently dropped.  Every control on the bus goes through the same
+// pacer, which also keeps their transactions from interleaving.
+class DDCPacer {
+ public:
+  // The DDC/CI spec asks hosts to leave 50ms after each command.
+  static constexpr absl::Duration kDefaultGap = absl::Milliseconds(50);
+
+  explicit DDCPacer(absl::Duration gap = kDefaultGap) : gap_(gap) {}
+  DDCPacer(const DDCPacer &) = delete;
+  DDCPacer &operator=(const DDCPacer &) = delete;
+
+  // When the bus will next take a command, if nobody else gets there first.
+  // Callers with something to send can wait until then without holding
+  // anything, and then send whatever is newest.
+  absl::Time ready_at() const;
+  // Waits until the bus is free and the gap since its last transaction has
+  // passed, then runs `transaction` with the bus to itself and returns
+  // whatever it does.
+  template <typename F>
+  auto Run(F transaction) {
+    Acquire();
+    auto ret = transaction();
+    Release();
+    return ret;
+  }
+  // Time spent in `Run` waiting for the gap, as opposed to for the bus.
+  absl::Duration paced() const;
+  // Traffic over the bus, from every control on it.
+  TransportStats &stats() { return stats_; }
+
+ private:
+  void Acquire();
+  void Release();
+
+  const absl::Duration gap_;
+  mutable absl::Mutex lock_;
+  bool busy_ ABSL_GUARDED_BY(lock_) = false;
+  absl::Time last_end_ ABSL_GUARDED_BY(lock_) = absl::InfinitePast();
+  // How long the current transaction waited for the gap.
+  absl::Duration wait_ ABSL_GUARDED_BY(lock_);
+  absl::Duration paced_ ABSL_GUARDED_BY(lock_);
+  TransportStats stats_;
+};
+
+// Hands out one `DDCPacer` per physical link, for as long as anything holds
+// it.  Links are named by their I2C device, or for DP MST branches, which
+// share one, by whatever stands in for it.
+class DDCPacers {
+ public:
+  explicit DDCPacers(absl::Duration gap = DDCPacer::kDefaultGap)
+      : gap_(gap) {}
+  DDCPacers(const DDCPacers &) = delete;
+  DDCPacers &operator=(const DDCPacers &) = delete;
+
+  std::shared_ptr<DDCPacer> Get(absl::string_view device);
+  // Every pacer still in use, by link.
+  std::vector<std::pair<std::string, std::shared_ptr<DDCPacer>>> All();
+
+ private:
+  const absl::Duration gap_;
+  absl::Mutex lock_;
+  std::map<std::string, std::weak_ptr<DDCPacer>, std::less<>> pacers_
+      ABSL_GUARDED_BY(lock_);
+};
+}  // namespace jjaro
+#endif  // JJARO_DDC_PACER_H_
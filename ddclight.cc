@@ -1,6 +1,10 @@
 #include <absl/functional/any_invocable.h>
+#include <absl/status/status.h>
 #include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
 #include <absl/strings/string_view.h>
 #include <sdbus-c++/IConnection.h>
 #include <sdbus-c++/Types.h>
@@ -8,14 +12,72 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <map>
 #include <memory>
+#include <optional>
 #include <string>
+#include <tuple>
+#include <utility>
 
 #include "client.h"
+#include "line-socket.h"
+#include "reactor.h"
 #include "server.h"
+#include "trace.h"
+
+namespace {
+// VCP codes are usually written in hex, as in the MCCS spec.
+bool ParseVCPCode(absl::string_view arg, int64_t* code) {
+  if (absl::ConsumePrefix(&arg, "0x")) return absl::SimpleHexAtoi(arg, code);
+  return absl::SimpleAtoi(arg, code);
+}
+
+// Takes `<output>=<percentage>`.
+bool ParseOutputPercentage(absl::string_view arg,
+                           std::map<std::string, int64_t>* percentages) {
+  const std::pair<absl::string_view, absl::string_view> parts =
+      absl::StrSplit(arg, absl::MaxSplits('=', 1));
+  int64_t percentage;
+  if (parts.first.empty() || !absl::SimpleAtoi(parts.second, &percentage))
+    return false;
+  percentages->insert_or_assign(std::string(parts.first), percentage);
+  return true;
+}
+
+// Makes `request` over the daemon's socket, which saves setting up a bus
+// connection.  Returns nothing if the daemon isn't listening, for the caller
+// to go through D-Bus instead, which also starts the daemon if need be.  Any
+// later failure exits rather than risk the request being made twice.
+std::optional<int64_t> SocketCall(absl::string_view request) {
+  const std::string path = jjaro::SocketPath();
+  if (path.empty()) return std::nullopt;
+  auto client = jjaro::LineSocketClient::Connect(path);
+  if (!client.ok()) return std::nullopt;
+  const auto reply = client->Call(request);
+  int64_t ret;
+  if (reply.ok() && absl::SimpleAtoi(*reply, &ret)) return ret;
+  absl::FPrintF(stderr, "%s failed: %s\n", request,
+                reply.ok() ? *reply : reply.status().ToString());
+  exit(EXIT_FAILURE);
+}
+
+// Prints each percentage the daemon sends after `watch` until it goes away.
+absl::Status SocketWatch(jjaro::LineSocketClient* client) {
+  if (auto ss = client->Send("watch"); !ss.ok()) return ss;
+  while (true) {
+    const auto line = client->ReadLine();
+    if (!line.ok()) return line.status();
+    absl::PrintF("%s\n", *line);
+  }
+}
+}  // namespace
 
 int main(int argc, char** argv) {
   if (argc == 2 && argv && argv[1] && absl::string_view(argv[1]) == "get") {
+    if (const auto percentage = SocketCall("get")) {
+      absl::PrintF("%d ddclight\n", *percentage);
+      return EXIT_SUCCESS;
+    }
     auto connection = sdbus::createSessionBusConnection();
     absl::PrintF("%d ddclight\n",
                  jjaro::DDCLightProxy(*connection,
@@ -36,6 +98,10 @@ int main(int argc, char** argv) {
              absl::string_view(argv[1]) == "set") {
     int64_t arg;
     if (argv[2] && absl::SimpleAtoi(argv[2], &arg)) {
+      if (const auto percentage = SocketCall(absl::StrCat("set ", arg))) {
+        absl::PrintF("%d ddclight\n", *percentage);
+        return EXIT_SUCCESS;
+      }
       auto connection = sdbus::createSessionBusConnection();
       absl::PrintF("%d ddclight\n",
                    jjaro::DDCLightProxy(
@@ -48,6 +114,10 @@ int main(int argc, char** argv) {
              absl::string_view(argv[1]) == "increment") {
     int64_t arg;
     if (argv[2] && absl::SimpleAtoi(argv[2], &arg)) {
+      if (const auto percentage = SocketCall(absl::StrCat("increment ", arg))) {
+        absl::PrintF("%d ddclight\n", *percentage);
+        return EXIT_SUCCESS;
+      }
       auto connection = sdbus::createSessionBusConnection();
       absl::PrintF("%d ddclight\n",
                    jjaro::DDCLightProxy(
@@ -60,6 +130,10 @@ int main(int argc, char** argv) {
              absl::string_view(argv[1]) == "decrement") {
     int64_t arg;
     if (argv[2] && absl::SimpleAtoi(argv[2], &arg)) {
+      if (const auto percentage = SocketCall(absl::StrCat("decrement ", arg))) {
+        absl::PrintF("%d ddclight\n", *percentage);
+        return EXIT_SUCCESS;
+      }
       auto connection = sdbus::createSessionBusConnection();
       absl::PrintF("%d ddclight\n",
                    jjaro::DDCLightProxy(
@@ -68,16 +142,166 @@ int main(int argc, char** argv) {
                        .decrement(arg));
       return EXIT_SUCCESS;
     }
+  } else if (argc == 4 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "fade") {
+    int64_t arg, duration_ms;
+    if (argv[2] && absl::SimpleAtoi(argv[2], &arg) && argv[3] &&
+        absl::SimpleAtoi(argv[3], &duration_ms)) {
+      auto connection = sdbus::createSessionBusConnection();
+      absl::PrintF("%d ddclight\n",
+                   jjaro::DDCLightProxy(
+                       *connection, sdbus::ServiceName("org.jjaro.ddclight"),
+                       sdbus::ObjectPath("/org/jjaro/ddclight"))
+                       .fade(arg, duration_ms));
+      return EXIT_SUCCESS;
+    }
+  } else if (argc == 2 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "getlevel") {
+    if (const auto level = SocketCall("getlevel")) {
+      absl::PrintF("%d ddclight\n", *level);
+      return EXIT_SUCCESS;
+    }
+    auto connection = sdbus::createSessionBusConnection();
+    absl::PrintF("%d ddclight\n",
+                 jjaro::DDCLightProxy(*connection,
+                                      sdbus::ServiceName("org.jjaro.ddclight"),
+                                      sdbus::ObjectPath("/org/jjaro/ddclight"))
+                     .getlevel());
+    return EXIT_SUCCESS;
+  } else if (argc == 3 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "setlevel") {
+    int64_t arg;
+    if (argv[2] && absl::SimpleAtoi(argv[2], &arg)) {
+      if (const auto level = SocketCall(absl::StrCat("setlevel ", arg))) {
+        absl::PrintF("%d ddclight\n", *level);
+        return EXIT_SUCCESS;
+      }
+      auto connection = sdbus::createSessionBusConnection();
+      absl::PrintF("%d ddclight\n",
+                   jjaro::DDCLightProxy(
+                       *connection, sdbus::ServiceName("org.jjaro.ddclight"),
+                       sdbus::ObjectPath("/org/jjaro/ddclight"))
+                       .setlevel(arg));
+      return EXIT_SUCCESS;
+    }
+  } else if (argc == 4 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "fadelevel") {
+    int64_t arg, duration_ms;
+    if (argv[2] && absl::SimpleAtoi(argv[2], &arg) && argv[3] &&
+        absl::SimpleAtoi(argv[3], &duration_ms)) {
+      auto connection = sdbus::createSessionBusConnection();
+      absl::PrintF("%d ddclight\n",
+                   jjaro::DDCLightProxy(
+                       *connection, sdbus::ServiceName("org.jjaro.ddclight"),
+                       sdbus::ObjectPath("/org/jjaro/ddclight"))
+                       .fadelevel(arg, duration_ms));
+      return EXIT_SUCCESS;
+    }
+  } else if (argc == 3 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "getvcp") {
+    int64_t code;
+    if (argv[2] && ParseVCPCode(argv[2], &code)) {
+      auto connection = sdbus::createSessionBusConnection();
+      absl::PrintF("%d ddclight\n",
+                   jjaro::DDCLightProxy(
+                       *connection, sdbus::ServiceName("org.jjaro.ddclight"),
+                       sdbus::ObjectPath("/org/jjaro/ddclight"))
+                       .getvcp(code));
+      return EXIT_SUCCESS;
+    }
+  } else if (argc == 4 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "setvcp") {
+    int64_t code, arg;
+    if (argv[2] && ParseVCPCode(argv[2], &code) && argv[3] &&
+        absl::SimpleAtoi(argv[3], &arg)) {
+      auto connection = sdbus::createSessionBusConnection();
+      absl::PrintF("%d ddclight\n",
+                   jjaro::DDCLightProxy(
+                       *connection, sdbus::ServiceName("org.jjaro.ddclight"),
+                       sdbus::ObjectPath("/org/jjaro/ddclight"))
+                       .setvcp(code, arg));
+      return EXIT_SUCCESS;
+    }
+  } else if (argc >= 3 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "setmany") {
+    std::map<std::string, int64_t> percentages;
+    bool ok = true;
+    for (int i = 2; ok && i < argc; ++i)
+      ok = argv[i] && ParseOutputPercentage(argv[i], &percentages);
+    if (ok) {
+      auto connection = sdbus::createSessionBusConnection();
+      for (const auto& [output, percentage] :
+           jjaro::DDCLightProxy(*connection,
+                                sdbus::ServiceName("org.jjaro.ddclight"),
+                                sdbus::ObjectPath("/org/jjaro/ddclight"))
+               .setmany(percentages))
+        absl::PrintF("%d %s\n", percentage, output);
+      return EXIT_SUCCESS;
+    }
+  } else if ((argc == 3 || argc == 4) && argv && argv[1] &&
+             absl::string_view(argv[1]) == "setwait") {
+    int64_t arg, timeout_ms = 5000;
+    if (argv[2] && absl::SimpleAtoi(argv[2], &arg) &&
+        (argc == 3 || (argv[3] && absl::SimpleAtoi(argv[3], &timeout_ms)))) {
+      auto connection = sdbus::createSessionBusConnection();
+      const auto [percentage, outputs] =
+          jjaro::DDCLightProxy(*connection,
+                               sdbus::ServiceName("org.jjaro.ddclight"),
+                               sdbus::ObjectPath("/org/jjaro/ddclight"))
+              .setwait(arg, timeout_ms);
+      absl::PrintF("%d ddclight\n", percentage);
+      bool all_applied = true;
+      for (const auto& [output, result] : outputs) {
+        const bool applied = std::get<0>(result);
+        absl::PrintF("%d %s %s after %.1fms\n", std::get<1>(result), output,
+                     applied ? "applied" : "not applied", std::get<2>(result));
+        all_applied = all_applied && applied;
+      }
+      return all_applied ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+  } else if (argc == 2 && argv && argv[1] &&
+             absl::string_view(argv[1]) == "stats") {
+    auto connection = sdbus::createSessionBusConnection();
+    for (const auto& [section, values] :
+         jjaro::DDCLightProxy(*connection,
+                              sdbus::ServiceName("org.jjaro.ddclight"),
+                              sdbus::ObjectPath("/org/jjaro/ddclight"))
+             .stats()) {
+      absl::PrintF("%s\n", section);
+      for (const auto& [name, value] : values)
+        absl::PrintF("  %s %g\n", name, value);
+    }
+    return EXIT_SUCCESS;
   } else if (argc == 2 && argv && argv[1] &&
              absl::string_view(argv[1]) == "daemon") {
+    if (const char* const trace = getenv("DDCLIGHT_TRACE"); trace && *trace) {
+      if (const auto ts = jjaro::StartTracing(trace); !ts.ok())
+        absl::FPrintF(stderr, "Not tracing: %s\n", ts.ToString());
+      jjaro::TraceThreadName("reactor");
+    }
     const sdbus::ServiceName svc("org.jjaro.ddclight");
     auto connection = sdbus::createSessionBusConnection(svc);
-    jjaro::DDCLight ddc(*connection, sdbus::ObjectPath("/org/jjaro/ddclight"));
-    connection->enterEventLoop();
-    return EXIT_SUCCESS;
+    auto reactor = jjaro::Reactor::Create();
+    if (!reactor.ok()) {
+      absl::FPrintF(stderr, "Unable to start event loop: %s\n",
+                    reactor.status().ToString());
+      return EXIT_FAILURE;
+    }
+    jjaro::DDCLight ddc(*connection, sdbus::ObjectPath("/org/jjaro/ddclight"),
+                        &*reactor);
+    absl::FPrintF(stderr, "Event loop failed: %s\n",
+                  reactor->Run().ToString());
+    return EXIT_FAILURE;
   } else if (argc == 2 && argv && argv[1] &&
              absl::string_view(argv[1]) == "watch") {
     (void)setvbuf(stdout, nullptr, _IOLBF, 0);
+    if (const std::string path = jjaro::SocketPath(); !path.empty()) {
+      if (auto client = jjaro::LineSocketClient::Connect(path); client.ok()) {
+        absl::FPrintF(stderr, "Stopped watching: %s\n",
+                      SocketWatch(&*client).ToString());
+        return EXIT_FAILURE;
+      }
+    }
     auto connection = sdbus::createSessionBusConnection();
     jjaro::DDCLightProxy client(
         *connection, sdbus::ServiceName("org.jjaro.ddclight"),
@@ -95,6 +319,15 @@ int main(int argc, char** argv) {
                 "  %1$s set <percentage>\n"
                 "  %1$s increment <percentage>\n"
                 "  %1$s decrement <percentage>\n"
+                "  %1$s fade <percentage> <milliseconds>\n"
+                "  %1$s getlevel\n"
+                "  %1$s setlevel <level>\n"
+                "  %1$s fadelevel <level> <milliseconds>\n"
+                "  %1$s getvcp <code>\n"
+                "  %1$s setvcp <code> <value>\n"
+                "  %1$s setmany <output>=<percentage>...\n"
+                "  %1$s setwait <percentage> [<timeout ms>]\n"
+                "  %1$s stats\n"
                 "  %1$s daemon\n",
                 argc >= 1 && argv && argv[0] ? argv[0] : "ddclight");
   return EXIT_FAILURE;
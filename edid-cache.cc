@@ -0,0 +1,36 @@
+#include "edid-cache.h"
+
+#include <absl/functional/function_ref.h>
+#include <absl/status/statusor.h>
+#include <absl/synchronization/mutex.h>
+#include <sys/types.h>
+
+#include <string>
+#include <utility>
+
+namespace jjaro {
+absl::StatusOr<std::string> EDIDCache::Get(
+    const dev_t dev, absl::FunctionRef<absl::StatusOr<std::string>()> read) {
+  absl::MutexLock l(&lock_);
+  if (const auto [it, inserted] = entries_.try_emplace(dev); !inserted) {
+    // Somebody else got here first; wait for their read rather than issuing
+    // a second one on the same bus.
+    Entry &entry = it->second;
+    auto cond = [&entry]() { return entry.ready; };
+    lock_.Await(absl::Condition(&cond));
+    return entry.edid;
+  }
+  absl::StatusOr<std::string> edid;
+  {
+    lock_.Unlock();
+    edid = read();
+    lock_.Lock();
+  }
+  // `std::map` doesn't invalidate nodes on insert, but look the entry up again
+  // rather than holding an iterator across the unlock.
+  Entry &entry = entries_[dev];
+  entry.edid = std::move(edid);
+  entry.ready = true;
+  return entry.edid;
+}
+}  // namespace jjaro
@@ -0,0 +1,37 @@
+#ifndef JJARO_EDID_CACHE_H_
+#define JJARO_EDID_CACHE_H_ 1
+#include <absl/base/thread_annotations.h>
+#include <absl/functional/function_ref.h>
+#include <absl/status/statusor.h>
+#include <absl/synchronization/mutex.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+
+namespace jjaro {
+// Remembers EDIDs read over I2C for the length of one enumeration pass, keyed
+// by bus device number.  Matching several DP MST outputs against the same set
+// of buses then reads each bus at most once, even from concurrent probes.
+class EDIDCache {
+ public:
+  EDIDCache() = default;
+  EDIDCache(const EDIDCache &) = delete;
+  EDIDCache &operator=(const EDIDCache &) = delete;
+
+  // Returns the EDID for `dev`, calling `read` only if no other caller has
+  // already done so.  Failures are remembered too.
+  absl::StatusOr<std::string> Get(
+      dev_t dev, absl::FunctionRef<absl::StatusOr<std::string>()> read);
+
+ private:
+  struct Entry {
+    bool ready = false;
+    absl::StatusOr<std::string> edid;
+  };
+
+  absl::Mutex lock_;
+  std::map<dev_t, Entry> entries_ ABSL_GUARDED_BY(lock_);
+};
+}  // namespace jjaro
+#endif  // JJARO_EDID_CACHE_H_
@@ -0,0 +1,29 @@
+#ifndef JJARO_EDID_H_
+#define JJARO_EDID_H_ 1
+
+#include <absl/strings/string_view.h>
+
+#include <cstddef>
+#include <cstdint>
+
+namespace jjaro {
+constexpr size_t kEDIDBlockSize = 128;
+// Where the base block says how many extension blocks follow it.
+constexpr size_t kEDIDExtensionCountOffset = 126;
+// The E-DDC segment pointer can address 128 segments of two blocks each.
+constexpr size_t kEDIDMaxSize = 256 * kEDIDBlockSize;
+
+// Whether an EDID read over I2C is the one sysfs has.  Adapters that only
+// speak SMBus can't reach past the second block, so a read that came back
+// short of the blocks it declares is compared as far as it goes.
+inline bool EDIDMatches(absl::string_view read, absl::string_view sysfs) {
+  if (read.size() < kEDIDBlockSize) return false;
+  const size_t declared =
+      (1 + static_cast<uint8_t>(read[kEDIDExtensionCountOffset])) *
+      kEDIDBlockSize;
+  if (read.size() < declared && read.size() < sysfs.size())
+    return read == sysfs.substr(0, read.size());
+  return read == sysfs;
+}
+}  // namespace jjaro
+#endif  // JJARO_EDID_H_
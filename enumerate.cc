@@ -3,23 +3,26 @@
 #include <absl/functional/any_invocable.h>
 #include <absl/strings/str_format.h>
 #include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+#include <sys/epoll.h>
 #include <wayland-util.h>
 
 #include <cstdio>
 #include <memory>
 #include <string>
-#include <thread>
 #include <utility>
 #include <vector>
 
 namespace jjaro {
 Enumerator::Enumerator(
+    Reactor *reactor,
     absl::AnyInvocable<void(uint32_t name, uint32_t version)> add_output,
     absl::AnyInvocable<void(uint32_t name)> remove_output)
     : add_output_(std::move(add_output)),
       remove_output_(std::move(remove_output)),
       display_(nullptr),
-      registry_(nullptr) {
+      registry_(nullptr),
+      reactor_(reactor) {
   display_.reset(wl_display_connect(nullptr));
   if (!display_) {
     fputs(
@@ -27,7 +30,6 @@ Enumerator::Enumerator(
         stderr);
     return;
   }
-  thread_ = std::thread(WaylandThreadLoop, display_.get());
   registry_.reset(wl_display_get_registry(display_.get()));
   if (!registry_) {
     fputs(
@@ -42,17 +44,44 @@ Enumerator::Enumerator(
                   "Unable to listen to Wayland registry; no outputs will be "
                   "adjusted (%d).\n",
                   ret);
+    return;
+  }
+  if (const auto ws =
+          reactor_->Watch(wl_display_get_fd(display_.get()), EPOLLIN,
+                          [this](uint32_t) { Dispatch(); });
+      !ws.ok()) {
+    absl::FPrintF(stderr,
+                  "Unable to watch Wayland display; no outputs will be "
+                  "adjusted: %s.\n",
+                  ws.ToString());
+    return;
   }
+  prepare_id_ = reactor_->AddPrepare([this] { return Prepare(); });
 }
 
 Enumerator::~Enumerator() {
+  if (prepare_id_ != -1) {
+    reactor_->RemovePrepare(prepare_id_);
+    reactor_->Unwatch(wl_display_get_fd(display_.get())).IgnoreError();
+  }
   registry_.reset();
   display_.reset();
-  thread_.join();
 }
 
-void Enumerator::WaylandThreadLoop(struct wl_display *display) {
-  while (wl_display_dispatch(display) != -1);
+// Sends whatever requests the last round of events queued up, since nothing
+// else will before the reactor sleeps.
+absl::Time Enumerator::Prepare() {
+  wl_display_dispatch_pending(display_.get());
+  wl_display_flush(display_.get());
+  return absl::InfiniteFuture();
+}
+void Enumerator::Dispatch() {
+  if (wl_display_dispatch(display_.get()) != -1) return;
+  fputs("Lost Wayland display; no further outputs will be adjusted.\n",
+        stderr);
+  reactor_->RemovePrepare(prepare_id_);
+  prepare_id_ = -1;
+  reactor_->Unwatch(wl_display_get_fd(display_.get())).IgnoreError();
 }
 void Enumerator::HandleGlobal(void *enumerator, struct wl_registry *,
                               uint32_t name, const char *interface,
@@ -2,20 +2,23 @@
 #define JJARO_ENUMERATE_H_ 1
 
 #include <absl/functional/any_invocable.h>
+#include <absl/time/time.h>
 #include <wayland-client-core.h>
 #include <wayland-client-protocol.h>
 
 #include <cstdint>
 #include <memory>
-#include <thread>
 #include <vector>
 
 #include "deleter.h"
+#include "reactor.h"
 
 namespace jjaro {
 class Enumerator {
  public:
+  // Outputs are added and removed from within `reactor`'s loop.
   Enumerator(
+      Reactor *reactor,
       absl::AnyInvocable<void(uint32_t name, uint32_t version)> add_output,
       absl::AnyInvocable<void(uint32_t name)> remove_output);
   ~Enumerator();
@@ -23,7 +26,8 @@ class Enumerator {
   struct wl_registry *registry() const { return registry_.get(); }
 
  private:
-  static void WaylandThreadLoop(struct wl_display *display);
+  absl::Time Prepare();
+  void Dispatch();
   static void HandleGlobal(void *enumerator, struct wl_registry *,
                            uint32_t name, const char *interface,
                            uint32_t version);
@@ -37,7 +41,8 @@ class Enumerator {
   std::unique_ptr<struct wl_display, Deleter<wl_display_disconnect>> display_;
   std::unique_ptr<struct wl_registry, Deleter<wl_registry_destroy>> registry_;
   std::vector<uint32_t> output_names_;
-  std::thread thread_;
+  Reactor *reactor_;
+  int prepare_id_ = -1;
 };
 }  // namespace jjaro
 #endif  // JJARO_ENUMERATE_H_
@@ -0,0 +1,150 @@
+#include "hotplug.h"
+
+#include <absl/memory/memory.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/string_view.h>
+#include <endian.h>
+#include <linux/netlink.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "fd-holder.h"
+#include "reactor.h"
+
+namespace jjaro {
+namespace {
+// The group udevd passes events on to once its rules have run, so that device
+// nodes are in place with their permissions by the time we probe them.  The
+// kernel's own group, 1, gets there first but before any of that.
+constexpr uint32_t kUdevGroup = 2;
+// What udevd puts ahead of properties, all in host order except `magic`.
+constexpr absl::string_view kUdevPrefix("libudev\0", 8);
+constexpr uint32_t kUdevMagic = 0xfeedcafe;
+constexpr size_t kUdevMagicOffset = 8, kUdevPropertiesOffset = 16,
+                 kUdevPropertiesLength = 20, kUdevHeaderSize = 40;
+// udevd sends nothing bigger.
+constexpr size_t kMaxMessage = 8192;
+
+uint32_t Load32(absl::string_view message, size_t offset) {
+  uint32_t value;
+  memcpy(&value, message.data() + offset, sizeof(value));
+  return value;
+}
+
+bool IsWatched(absl::string_view subsystem) {
+  return subsystem == "drm" || subsystem == "i2c-dev" ||
+         subsystem == "backlight";
+}
+}  // namespace
+
+std::optional<Uevent> Uevent::Parse(absl::string_view message) {
+  absl::string_view properties;
+  if (absl::StartsWith(message, kUdevPrefix)) {
+    if (message.size() < kUdevHeaderSize ||
+        be32toh(Load32(message, kUdevMagicOffset)) != kUdevMagic)
+      return std::nullopt;
+    const uint32_t offset = Load32(message, kUdevPropertiesOffset);
+    const uint32_t length = Load32(message, kUdevPropertiesLength);
+    if (offset > message.size() || length > message.size() - offset)
+      return std::nullopt;
+    properties = message.substr(offset, length);
+  } else {
+    // The kernel's header is `ACTION@DEVPATH`, which the properties repeat.
+    const size_t end = message.find('\0');
+    if (end == absl::string_view::npos ||
+        message.substr(0, end).find('@') == absl::string_view::npos)
+      return std::nullopt;
+    properties = message.substr(end + 1);
+  }
+  Uevent event;
+  for (const absl::string_view property :
+       absl::StrSplit(properties, '\0', absl::SkipEmpty())) {
+    const std::pair<absl::string_view, absl::string_view> kv =
+        absl::StrSplit(property, absl::MaxSplits('=', 1));
+    if (kv.first == "ACTION") {
+      event.action = std::string(kv.second);
+    } else if (kv.first == "DEVPATH") {
+      event.devpath = std::string(kv.second);
+    } else if (kv.first == "SUBSYSTEM") {
+      event.subsystem = std::string(kv.second);
+    }
+  }
+  if (event.action.empty() || event.devpath.empty() || event.subsystem.empty())
+    return std::nullopt;
+  return event;
+}
+
+absl::string_view Uevent::Connector() const {
+  for (absl::string_view part : absl::StrSplit(devpath, '/')) {
+    if (!absl::ConsumePrefix(&part, "card")) continue;
+    const size_t dash = part.find('-');
+    if (dash == 0 || dash == absl::string_view::npos) continue;
+    if (!std::all_of(part.begin(), part.begin() + dash, absl::ascii_isdigit))
+      continue;
+    return part.substr(dash + 1);
+  }
+  return "";
+}
+
+absl::string_view Uevent::Device() const {
+  const absl::string_view path(devpath);
+  const size_t slash = path.rfind('/');
+  return slash == absl::string_view::npos ? path : path.substr(slash + 1);
+}
+
+absl::StatusOr<std::unique_ptr<HotplugMonitor>> HotplugMonitor::Create(
+    Reactor *reactor, Handler handler) {
+  FDHolder fd(socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                     NETLINK_KOBJECT_UEVENT));
+  if (fd.get() == -1)
+    return absl::ErrnoToStatus(errno, "failed to create uevent socket");
+  const sockaddr_nl addr = {.nl_family = AF_NETLINK, .nl_groups = kUdevGroup};
+  if (bind(fd.get(), reinterpret_cast<const sockaddr *>(&addr),
+           sizeof(addr)) != 0)
+    return absl::ErrnoToStatus(errno, "failed to bind uevent socket");
+  auto monitor = absl::WrapUnique(
+      new HotplugMonitor(reactor, std::move(fd), std::move(handler)));
+  if (auto ws = reactor->Watch(monitor->fd_.get(), EPOLLIN,
+                               [that = monitor.get()](uint32_t) {
+                                 that->Receive();
+                               });
+      !ws.ok())
+    return ws;
+  return monitor;
+}
+
+HotplugMonitor::~HotplugMonitor() {
+  reactor_->Unwatch(fd_.get()).IgnoreError();
+}
+
+void HotplugMonitor::Receive() {
+  char buf[kMaxMessage];
+  while (true) {
+    const ssize_t rret = recv(fd_.get(), buf, sizeof(buf), 0);
+    if (rret < 0 && errno == EINTR) continue;
+    // Events were dropped; any of them might have been a connector.
+    if (rret < 0 && errno == ENOBUFS) {
+      handler_(Uevent{.action = "change", .devpath = "", .subsystem = "drm"});
+      continue;
+    }
+    if (rret < 0) return;
+    // Only root can send to the group, so there's no sender to check.
+    const auto event = Uevent::Parse(absl::string_view(buf, rret));
+    if (!event || !IsWatched(event->subsystem)) continue;
+    handler_(*event);
+  }
+}
+}  // namespace jjaro
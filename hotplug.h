@@ -0,0 +1,54 @@
+#ifndef JJARO_HOTPLUG_H_
+#define JJARO_HOTPLUG_H_ 1
+#include <absl/functional/any_invocable.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "fd-holder.h"
+#include "reactor.h"
+
+// Device events from udev's netlink multicast group, so that a connector or
+// bus appearing late can be probed on its own, rather than waiting for the
+// compositor to announce the output again.
+namespace jjaro {
+struct Uevent {
+  std::string action, devpath, subsystem;
+
+  // Parses a udev or kernel uevent message, which is a header followed by
+  // NUL-terminated `KEY=value` properties.  Returns nothing for anything else.
+  static std::optional<Uevent> Parse(absl::string_view message);
+  // The output that the device hangs off, as in DP-2 from
+  // `.../drm/card1/card1-DP-2/i2c-5`, or empty for one not under a connector.
+  absl::string_view Connector() const;
+  // The device itself, as in i2c-5 or intel_backlight.
+  absl::string_view Device() const;
+};
+
+class HotplugMonitor {
+ public:
+  using Handler = absl::AnyInvocable<void(const Uevent &event)>;
+
+  // Hands `handler` every event for the drm, i2c-dev, and backlight
+  // subsystems, from `reactor`, which must outlive the monitor.
+  static absl::StatusOr<std::unique_ptr<HotplugMonitor>> Create(
+      Reactor *reactor, Handler handler);
+  HotplugMonitor(const HotplugMonitor &) = delete;
+  HotplugMonitor &operator=(const HotplugMonitor &) = delete;
+  ~HotplugMonitor();
+
+ private:
+  HotplugMonitor(Reactor *reactor, FDHolder fd, Handler handler)
+      : reactor_(reactor), fd_(std::move(fd)), handler_(std::move(handler)) {}
+  void Receive();
+
+  Reactor *reactor_;
+  FDHolder fd_;
+  Handler handler_;
+};
+}  // namespace jjaro
+#endif  // JJARO_HOTPLUG_H_
@@ -0,0 +1,165 @@
+#include "i2c-transport.h"
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <absl/types/span.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <sys/ioctl.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "edid.h"
+#include "fd-holder.h"
+
+namespace jjaro {
+namespace {
+constexpr uint16_t kDeviceBusAddr{0x37};
+constexpr uint16_t kEDIDBusAddr{0x50};
+constexpr uint16_t kEDIDSegmentBusAddr{0x30};
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<DevI2CTransport>> DevI2CTransport::Create(
+    FDHolder fd) {
+  std::unique_ptr<DevI2CTransport> transport(
+      new DevI2CTransport(std::move(fd)));
+  if (auto ss = transport->SetAddress(kDeviceBusAddr); !ss.ok()) return ss;
+  return transport;
+}
+
+absl::Status DevI2CTransport::Write(absl::Span<const std::byte> buf) {
+  while (true) {
+    const ssize_t wret = write(fd_.get(), buf.data(), buf.size());
+    if (wret < 0 && errno == EINTR) continue;
+    if (wret < 0) return absl::ErrnoToStatus(errno, "write failed");
+    if (wret != static_cast<ssize_t>(buf.size()))
+      return absl::UnavailableError(
+          absl::StrCat("short write: ", wret, " of ", buf.size(), " bytes"));
+    return absl::OkStatus();
+  }
+}
+
+absl::Status DevI2CTransport::Read(absl::Span<std::byte> buf) {
+  while (true) {
+    const ssize_t rret = read(fd_.get(), buf.data(), buf.size());
+    if (rret < 0 && errno == EINTR) continue;
+    if (rret < 0) return absl::ErrnoToStatus(errno, "read failed");
+    if (rret != static_cast<ssize_t>(buf.size()))
+      return absl::UnavailableError(
+          absl::StrCat("short read: ", rret, " of ", buf.size(), " bytes"));
+    return absl::OkStatus();
+  }
+}
+
+absl::Status DevI2CTransport::SetAddress(const uint16_t addr) {
+  while (true) {
+    const int ret = ioctl(fd_.get(), I2C_SLAVE, addr);
+    if (ret != 0 && errno == EINTR) continue;
+    if (ret != 0)
+      return absl::ErrnoToStatus(
+          errno,
+          absl::StrCat("failed to set I2C_SLAVE address 0x", absl::Hex(addr)));
+    return absl::OkStatus();
+  }
+}
+
+absl::StatusOr<std::string> DevI2CTransport::ReadEDID() {
+  std::string buf(kEDIDBlockSize, '\0');
+  const auto as_bytes = [&buf](size_t block) {
+    return absl::MakeSpan(reinterpret_cast<std::byte *>(buf.data()),
+                          buf.size())
+        .subspan(block * kEDIDBlockSize, kEDIDBlockSize);
+  };
+  unsigned long funcs;
+  while (true) {
+    const int ret = ioctl(fd_.get(), I2C_FUNCS, &funcs);
+    if (ret != 0 && errno == EINTR) continue;
+    if (ret != 0) return absl::ErrnoToStatus(errno, "I2C_FUNCS failed");
+    break;
+  }
+  const auto read_block = funcs & I2C_FUNC_I2C
+                              ? &DevI2CTransport::ReadEDIDBlock
+                              : &DevI2CTransport::ReadEDIDBlockSMBus;
+  if (auto rs = (this->*read_block)(0, as_bytes(0)); !rs.ok()) return rs;
+  // Without the segment pointer, SMBus only reaches the first two blocks.
+  const uint8_t declared = buf[kEDIDExtensionCountOffset];
+  const uint8_t extensions =
+      funcs & I2C_FUNC_I2C ? declared : std::min<uint8_t>(declared, 1);
+  buf.resize((1 + extensions) * kEDIDBlockSize);
+  for (uint16_t block = 1; block <= extensions; block++)
+    if (auto rs = (this->*read_block)(block, as_bytes(block)); !rs.ok())
+      return rs;
+  return buf;
+}
+
+// Reads a whole block in one combined transaction: set the E-DDC segment
+// pointer if needed, write the offset, then read 128 bytes.
+absl::Status DevI2CTransport::ReadEDIDBlock(uint8_t block,
+                                            absl::Span<std::byte> buf) {
+  uint8_t segment = block / 2;
+  uint8_t offset = (block % 2) * kEDIDBlockSize;
+  std::array<struct i2c_msg, 3> msgs{
+      i2c_msg{.addr = kEDIDSegmentBusAddr,
+              .flags = 0,
+              .len = 1,
+              .buf = &segment},
+      i2c_msg{.addr = kEDIDBusAddr, .flags = 0, .len = 1, .buf = &offset},
+      i2c_msg{.addr = kEDIDBusAddr,
+              .flags = I2C_M_RD,
+              .len = static_cast<uint16_t>(buf.size()),
+              .buf = reinterpret_cast<uint8_t *>(buf.data())}};
+  // Monitors without extension segments may NAK the segment pointer, so only
+  // send it when it's actually needed.
+  struct i2c_rdwr_ioctl_data args{.msgs = msgs.data() + (segment ? 0 : 1),
+                                  .nmsgs = segment ? 3u : 2u};
+  while (true) {
+    const int ret = ioctl(fd_.get(), I2C_RDWR, &args);
+    if (ret < 0 && errno == EINTR) continue;
+    if (ret < 0)
+      return absl::ErrnoToStatus(
+          errno, absl::StrCat("I2C read of EDID block ", block, " failed"));
+    return absl::OkStatus();
+  }
+}
+
+// Some adapters only speak SMBus, which means a byte at a time, no segment
+// pointer, and borrowing the bus address from DDC/CI for the duration.
+absl::Status DevI2CTransport::ReadEDIDBlockSMBus(uint8_t block,
+                                                 absl::Span<std::byte> buf) {
+  if (block > 1)
+    return absl::UnimplementedError(
+        absl::StrCat("EDID block ", block, " needs plain I2C support"));
+  if (auto ss = SetAddress(kEDIDBusAddr); !ss.ok()) return ss;
+  struct i2c_smbus_ioctl_data args;
+  memset(&args, 0, sizeof(args));
+  args.read_write = I2C_SMBUS_READ;
+  args.size = I2C_SMBUS_BYTE_DATA;
+  union i2c_smbus_data data;
+  args.data = &data;
+  for (size_t i = 0; i < buf.size(); i++) {
+    args.command = block * kEDIDBlockSize + i;
+    while (true) {
+      const int ret = ioctl(fd_.get(), I2C_SMBUS, &args);
+      if (ret != 0 && errno == EINTR) continue;
+      if (ret != 0) {
+        SetAddress(kDeviceBusAddr).IgnoreError();
+        return absl::ErrnoToStatus(errno, "SMBus read failed");
+      }
+      buf[i] = static_cast<std::byte>(data.byte);
+      break;
+    }
+  }
+  return SetAddress(kDeviceBusAddr);
+}
+}  // namespace jjaro
@@ -0,0 +1,62 @@
+#ifndef JJARO_I2C_TRANSPORT_H_
+#define JJARO_I2C_TRANSPORT_H_ 1
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+#include <absl/types/span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "fd-holder.h"
+
+namespace jjaro {
+// Carries DDC/CI traffic between us and one monitor.  The DDC state machine in
+// `I2CDDCControl` only talks through this, so it can run against an emulated
+// monitor as easily as a real bus.
+class I2CTransport {
+ public:
+  virtual ~I2CTransport() = default;
+  // Writes `buf` to the DDC/CI address, 0x37.
+  virtual absl::Status Write(absl::Span<const std::byte> buf) = 0;
+  // Reads exactly `buf.size()` bytes from the DDC/CI address.
+  virtual absl::Status Read(absl::Span<std::byte> buf) = 0;
+  // Reads the EDID from 0x50, extension blocks included as far as the
+  // adapter can address them.  The count at byte 126 says how many there
+  // should be, which may be more than came back.
+  virtual absl::StatusOr<std::string> ReadEDID() = 0;
+};
+
+// Opens transports by bus name, e.g. "i2c-7".  Probes use one in place of
+// `/dev` when `ProbeContext::i2c_opener` is set.
+class I2CBusOpener {
+ public:
+  virtual ~I2CBusOpener() = default;
+  virtual absl::StatusOr<std::unique_ptr<I2CTransport>> Open(
+      absl::string_view device) = 0;
+};
+
+// A `/dev/i2c-*` node.
+class DevI2CTransport : public I2CTransport {
+ public:
+  // Points `fd` at the DDC/CI address.
+  static absl::StatusOr<std::unique_ptr<DevI2CTransport>> Create(FDHolder fd);
+  ~DevI2CTransport() override = default;
+
+  absl::Status Write(absl::Span<const std::byte> buf) override;
+  absl::Status Read(absl::Span<std::byte> buf) override;
+  absl::StatusOr<std::string> ReadEDID() override;
+
+ private:
+  explicit DevI2CTransport(FDHolder fd) : fd_(std::move(fd)) {}
+  absl::Status SetAddress(uint16_t addr);
+  absl::Status ReadEDIDBlock(uint8_t block, absl::Span<std::byte> buf);
+  absl::Status ReadEDIDBlockSMBus(uint8_t block, absl::Span<std::byte> buf);
+
+  FDHolder fd_;
+};
+}  // namespace jjaro
+#endif  // JJARO_I2C_TRANSPORT_H_
@@ -0,0 +1,210 @@
+#include "line-socket.h"
+
+#include <absl/memory/memory.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/string_view.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "fd-holder.h"
+#include "reactor.h"
+
+namespace jjaro {
+namespace {
+// Requests are a word and a number; anything much longer isn't one.
+constexpr size_t kMaxRequest = 256;
+// A watcher that lets this much back up has stopped reading.
+constexpr size_t kMaxPending = 4096;
+
+absl::StatusOr<sockaddr_un> Address(const std::string &path) {
+  sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (path.size() >= sizeof(addr.sun_path))
+    return absl::InvalidArgumentError(
+        absl::StrCat("socket path too long: ", path));
+  memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+  return addr;
+}
+}  // namespace
+
+std::string SocketPath() {
+  const char *const runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (!runtime_dir || !*runtime_dir) return "";
+  return absl::StrCat(runtime_dir, "/ddclight.sock");
+}
+
+absl::StatusOr<std::unique_ptr<LineSocketServer>> LineSocketServer::Listen(
+    Reactor *reactor, std::string path, Handler handler) {
+  const auto addr = Address(path);
+  if (!addr.ok()) return addr.status();
+  FDHolder fd(socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0));
+  if (fd.get() == -1)
+    return absl::ErrnoToStatus(errno, "failed to create socket");
+  // Only one daemon holds the bus name, so anything here is left over.
+  if (unlink(path.c_str()) != 0 && errno != ENOENT)
+    return absl::ErrnoToStatus(errno, absl::StrCat("failed to remove ", path));
+  if (bind(fd.get(), reinterpret_cast<const sockaddr *>(&*addr),
+           sizeof(*addr)) != 0)
+    return absl::ErrnoToStatus(errno, absl::StrCat("failed to bind ", path));
+  if (listen(fd.get(), SOMAXCONN) != 0)
+    return absl::ErrnoToStatus(errno, absl::StrCat("failed to listen ", path));
+  auto server = absl::WrapUnique(new LineSocketServer(
+      reactor, std::move(path), std::move(fd), std::move(handler)));
+  if (auto ws = reactor->Watch(server->listen_fd_.get(), EPOLLIN,
+                               [that = server.get()](uint32_t) {
+                                 that->Accept();
+                               });
+      !ws.ok())
+    return ws;
+  return server;
+}
+
+LineSocketServer::~LineSocketServer() {
+  for (const auto &[fd, connection] : connections_)
+    reactor_->Unwatch(fd).IgnoreError();
+  reactor_->Unwatch(listen_fd_.get()).IgnoreError();
+  unlink(path_.c_str());
+}
+
+void LineSocketServer::Broadcast(absl::string_view line) {
+  for (auto &[fd, connection] : connections_)
+    if (connection.watching) Send(connection, line);
+  // Writes wait for the reactor, since a watcher that's gone can't be closed
+  // from here while `Serve` might be running a request for it.
+  for (auto &[fd, connection] : connections_)
+    if (!connection.out.empty())
+      reactor_->Watch(fd, EPOLLIN | EPOLLOUT).IgnoreError();
+}
+
+void LineSocketServer::Accept() {
+  while (true) {
+    const int fd = accept4(listen_fd_.get(), nullptr, nullptr,
+                           SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1 && errno == EINTR) continue;
+    if (fd == -1) return;
+    connections_[fd].fd = FDHolder(fd);
+    if (const auto ws = reactor_->Watch(
+            fd, EPOLLIN, [this, fd](uint32_t events) { Serve(fd, events); });
+        !ws.ok())
+      connections_.erase(fd);
+  }
+}
+
+void LineSocketServer::Serve(int fd, uint32_t events) {
+  const auto it = connections_.find(fd);
+  if (it == connections_.end()) return;
+  Connection &connection = it->second;
+  if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+    char buf[kMaxRequest];
+    ssize_t rret;
+    do {
+      rret = read(fd, buf, sizeof(buf));
+    } while (rret < 0 && errno == EINTR);
+    if (rret == 0 || (rret < 0 && errno != EAGAIN)) return Close(fd);
+    if (rret > 0) connection.in.append(buf, rret);
+    size_t start = 0;
+    for (size_t end; (end = connection.in.find('\n', start)) !=
+                     std::string::npos;
+         start = end + 1) {
+      const absl::string_view request(connection.in.data() + start,
+                                      end - start);
+      if (request == "watch") {
+        connection.watching = true;
+        Send(connection, handler_("get"));
+      } else {
+        Send(connection, handler_(request));
+      }
+    }
+    connection.in.erase(0, start);
+    if (connection.in.size() > kMaxRequest) return Close(fd);
+  }
+  if (!Flush(connection)) Close(fd);
+}
+
+void LineSocketServer::Send(Connection &connection, absl::string_view line) {
+  absl::StrAppend(&connection.out, line, "\n");
+}
+
+// Writes what it can of `connection.out`, and has the reactor say when it can
+// take the rest.  Returns false if the connection should be closed.
+bool LineSocketServer::Flush(Connection &connection) {
+  while (!connection.out.empty()) {
+    const ssize_t wret = send(connection.fd.get(), connection.out.data(),
+                              connection.out.size(), MSG_NOSIGNAL);
+    if (wret < 0 && errno == EINTR) continue;
+    if (wret < 0 && errno == EAGAIN) break;
+    if (wret < 0) return false;
+    connection.out.erase(0, wret);
+  }
+  if (connection.out.size() > kMaxPending) return false;
+  return reactor_
+      ->Watch(connection.fd.get(),
+              connection.out.empty() ? EPOLLIN : EPOLLIN | EPOLLOUT)
+      .ok();
+}
+
+void LineSocketServer::Close(int fd) {
+  reactor_->Unwatch(fd).IgnoreError();
+  connections_.erase(fd);
+}
+
+absl::StatusOr<LineSocketClient> LineSocketClient::Connect(
+    const std::string &path) {
+  const auto addr = Address(path);
+  if (!addr.ok()) return addr.status();
+  FDHolder fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  if (fd.get() == -1)
+    return absl::ErrnoToStatus(errno, "failed to create socket");
+  while (connect(fd.get(), reinterpret_cast<const sockaddr *>(&*addr),
+                 sizeof(*addr)) != 0)
+    if (errno != EINTR)
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("failed to connect ", path));
+  return LineSocketClient(std::move(fd));
+}
+
+absl::StatusOr<std::string> LineSocketClient::Call(absl::string_view request) {
+  if (auto ss = Send(request); !ss.ok()) return ss;
+  return ReadLine();
+}
+
+absl::Status LineSocketClient::Send(absl::string_view request) {
+  const std::string line = absl::StrCat(request, "\n");
+  absl::string_view rest = line;
+  while (!rest.empty()) {
+    const ssize_t wret =
+        send(fd_.get(), rest.data(), rest.size(), MSG_NOSIGNAL);
+    if (wret < 0 && errno == EINTR) continue;
+    if (wret < 0) return absl::ErrnoToStatus(errno, "socket write failed");
+    rest.remove_prefix(wret);
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::string> LineSocketClient::ReadLine() {
+  while (true) {
+    if (const size_t end = in_.find('\n'); end != std::string::npos) {
+      std::string line = in_.substr(0, end);
+      in_.erase(0, end + 1);
+      return line;
+    }
+    char buf[kMaxRequest];
+    const ssize_t rret = read(fd_.get(), buf, sizeof(buf));
+    if (rret < 0 && errno == EINTR) continue;
+    if (rret < 0) return absl::ErrnoToStatus(errno, "socket read failed");
+    if (rret == 0) return absl::UnavailableError("daemon closed the socket");
+    in_.append(buf, rret);
+  }
+}
+}  // namespace jjaro
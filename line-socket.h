@@ -0,0 +1,91 @@
+#ifndef JJARO_LINE_SOCKET_H_
+#define JJARO_LINE_SOCKET_H_ 1
+#include <absl/functional/any_invocable.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "fd-holder.h"
+#include "reactor.h"
+
+// A Unix socket alongside D-Bus for the commands key bindings make, which
+// saves clients a bus connection and a round trip through the broker.
+//
+// Requests and replies are single lines.  Requests are a command and its
+// argument, if any, separated by a space: `get`, `set <percentage>`,
+// `increment <percentage>`, `decrement <percentage>`, and `watch`.  Replies
+// are the resulting percentage, or `error <message>`.  After `watch`'s reply,
+// the connection gets a line with each new percentage until it's closed.
+namespace jjaro {
+// Where the daemon listens: `ddclight.sock` in `$XDG_RUNTIME_DIR`, or empty
+// if that's unset, in which case it doesn't.
+std::string SocketPath();
+
+class LineSocketServer {
+ public:
+  // Takes a request, minus its newline, and returns the reply, minus its.
+  using Handler = absl::AnyInvocable<std::string(absl::string_view request)>;
+
+  // Listens at `path`, replacing any socket left there, and serves
+  // connections from `reactor`, which must outlive the server.  `handler`
+  // answers every request besides `watch`, which gets what `get` does.
+  static absl::StatusOr<std::unique_ptr<LineSocketServer>> Listen(
+      Reactor *reactor, std::string path, Handler handler);
+  LineSocketServer(const LineSocketServer &) = delete;
+  LineSocketServer &operator=(const LineSocketServer &) = delete;
+  ~LineSocketServer();
+
+  // Sends `line` to every connection that's watching.
+  void Broadcast(absl::string_view line);
+
+ private:
+  struct Connection {
+    FDHolder fd;
+    std::string in, out;
+    bool watching = false;
+  };
+
+  LineSocketServer(Reactor *reactor, std::string path, FDHolder listen_fd,
+                   Handler handler)
+      : reactor_(reactor),
+        path_(std::move(path)),
+        listen_fd_(std::move(listen_fd)),
+        handler_(std::move(handler)) {}
+  void Accept();
+  void Serve(int fd, uint32_t events);
+  void Send(Connection &connection, absl::string_view line);
+  bool Flush(Connection &connection);
+  void Close(int fd);
+
+  Reactor *reactor_;
+  std::string path_;
+  FDHolder listen_fd_;
+  Handler handler_;
+  std::map<int, Connection> connections_;
+};
+
+// A blocking connection to a `LineSocketServer`.
+class LineSocketClient {
+ public:
+  static absl::StatusOr<LineSocketClient> Connect(const std::string &path);
+
+  // Sends `request` and returns the reply.
+  absl::StatusOr<std::string> Call(absl::string_view request);
+  absl::Status Send(absl::string_view request);
+  // Returns the next line from the server, minus its newline.
+  absl::StatusOr<std::string> ReadLine();
+
+ private:
+  explicit LineSocketClient(FDHolder fd) : fd_(std::move(fd)) {}
+
+  FDHolder fd_;
+  std::string in_;
+};
+}  // namespace jjaro
+#endif  // JJARO_LINE_SOCKET_H_
@@ -0,0 +1,168 @@
+// How far apart a backlight and two DDC/CI monitors on buses of their own
+// land each new target, with and without `Lockstep` holding the first write
+// until every bus is free.  Targets come in at different points in the
+// buses' gaps, as key presses do.
+#include <absl/strings/str_cat.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "brightness.h"
+#include "control-ddc-i2c.h"
+#include "control.h"
+#include "ddc-emulator.h"
+#include "ddc-pacer.h"
+#include "edid-cache.h"
+#include "lockstep.h"
+#include "state.h"
+#include "stats.h"
+#include "sysfs-fixture.h"
+#include "waker.h"
+
+namespace jjaro {
+namespace {
+// Published in place of a level the control failed to apply.
+constexpr int kFailed = -2;
+
+// Follows `desired_level` onto `control` until `stop`, as `Output` does,
+// holding each new target for `lockstep` if `hold`.
+void Follow(State *state, Control *control, Lockstep *lockstep, bool hold,
+            const std::atomic<bool> *stop, std::atomic<int> *applied,
+            Waker *done) {
+  Waker waker;
+  state->Subscribe(&waker);
+  uint64_t seen_generation = ~uint64_t{0}, relayed_generation = 0;
+  while (true) {
+    const uint32_t seq = waker.seq();
+    const uint64_t generation =
+        state->generation.load(std::memory_order_acquire);
+    // `State` only wakes the first follower asleep, so pass it on, as
+    // `Output` does.
+    if (generation != relayed_generation) {
+      relayed_generation = generation;
+      state->WakeAfter(&waker);
+    }
+    if (stop->load(std::memory_order_relaxed)) break;
+    if (generation == seen_generation) {
+      waker.WaitUntil(seq, absl::InfiniteFuture());
+      continue;
+    }
+    seen_generation = generation;
+    int level;
+    uint64_t change;
+    {
+      absl::MutexLock l(&state->lock);
+      level = state->DesiredFor("bench").value_or(0);
+      change = state->target_changes;
+    }
+    if (hold) absl::SleepFor(lockstep->ReleaseAt(absl::Now()) - absl::Now());
+    if (control->SetBrightnessLevel(level).ok()) {
+      lockstep->Applied(change, absl::Now());
+    } else {
+      level = kFailed;
+    }
+    applied->store(level, std::memory_order_release);
+    done->Wake();
+  }
+  state->Unsubscribe(&waker);
+}
+
+void BM_LockstepSkew(benchmark::State &bm) {
+  const bool hold = bm.range(0);
+  auto sysfs = SyntheticSysfs::Create({.backlights = 1});
+  if (!sysfs.ok()) {
+    bm.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EDIDCache edid_cache;
+  std::vector<std::unique_ptr<Control>> controls;
+  auto backlight = Control::Probe(
+      sysfs->outputs()[0], {.root = sysfs->root(), .edid_cache = &edid_cache});
+  if (!backlight.ok()) {
+    bm.SkipWithError(backlight.status().ToString().c_str());
+    return;
+  }
+  controls.push_back(*std::move(backlight));
+  // About what a 100kHz bus gives.
+  const EmulatedMonitorOptions options{
+      .reply_latency = absl::ZeroDuration(),
+      .byte_time = absl::Microseconds(90)};
+  EmulatedDDCMonitor first("", options), second("", options);
+  for (EmulatedDDCMonitor *const monitor : {&first, &second}) {
+    auto ddc = I2CDDCControl::Create(absl::StrCat("i2c-", controls.size()),
+                                     monitor->Connect(), /*verify_every=*/0,
+                                     std::make_shared<DDCPacer>());
+    if (!ddc.ok()) {
+      bm.SkipWithError(ddc.status().ToString().c_str());
+      return;
+    }
+    controls.push_back(std::make_unique<I2CDDCControl>(*std::move(ddc)));
+  }
+  Lockstep lockstep;
+  for (const auto &control : controls) lockstep.Join(control.get());
+  State state;
+  std::atomic<bool> stop = false;
+  std::vector<std::atomic<int>> applied(controls.size());
+  for (auto &a : applied) a.store(-1);
+  Waker done;
+  std::vector<std::thread> followers;
+  for (size_t i = 0; i < controls.size(); ++i)
+    followers.emplace_back(Follow, &state, controls[i].get(), &lockstep,
+                           hold, &stop, &applied[i], &done);
+  int percent = 0;
+  bool ok = true;
+  for (auto _ : bm) {
+    // Somewhere different in the gap each time.
+    absl::SleepFor(DDCPacer::kDefaultGap * (percent % 7) / 7);
+    percent = (percent + 1) % 101;
+    const int level = LevelFromPercent(percent);
+    {
+      StateUpdate u(&state);
+      state.desired_level = level;
+      u.TargetChanged();
+    }
+    for (const auto &a : applied) {
+      while (true) {
+        const uint32_t seq = done.seq();
+        const int got = a.load(std::memory_order_acquire);
+        if (got == level || got == kFailed) {
+          ok = got == level;
+          break;
+        }
+        done.WaitUntil(seq, absl::InfiniteFuture());
+      }
+      if (!ok) break;
+    }
+    if (!ok) break;
+  }
+  {
+    StateUpdate u(&state);
+    stop.store(true, std::memory_order_relaxed);
+    u.Changed();
+  }
+  for (auto &follower : followers) follower.join();
+  for (const auto &control : controls) lockstep.Leave(control.get());
+  if (!ok) {
+    bm.SkipWithError("a control failed to apply a level");
+    return;
+  }
+  StatsReport report;
+  lockstep.Report(&report);
+  for (const char *const stat : {"skew_mean_ms", "skew_p99_ms", "skew_max_ms"})
+    bm.counters[stat] = report[stat];
+}
+BENCHMARK(BM_LockstepSkew)
+    ->ArgNames({"hold"})
+    ->Arg(0)
+    ->Arg(1)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+}  // namespace
+}  // namespace jjaro
@@ -0,0 +1,65 @@
+#include "lockstep.h"
+
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace jjaro {
+void Lockstep::Join(const Control *control) {
+  absl::MutexLock l(&lock_);
+  members_.push_back(control);
+}
+
+void Lockstep::Leave(const Control *control) {
+  absl::MutexLock l(&lock_);
+  members_.erase(std::remove(members_.begin(), members_.end(), control),
+                 members_.end());
+  // Whoever's left may be all that was still to write.
+  if (open_ && written_ >= members_.size()) Finish();
+}
+
+// Controls that aren't paced are always ready, so an output on its own, or
+// with only backlights for company, is never held.
+absl::Time Lockstep::ReleaseAt(const absl::Time now) const {
+  absl::Time ready = absl::InfinitePast();
+  absl::MutexLock l(&lock_);
+  for (const Control *const control : members_)
+    ready = std::max(ready, control->next_command_time());
+  return std::min(ready, now + kMaxHold);
+}
+
+void Lockstep::Applied(const uint64_t change, const absl::Time at) {
+  absl::MutexLock l(&lock_);
+  if (change < change_ || (change == change_ && !open_)) return;
+  if (change > change_) {
+    if (open_) Finish();
+    change_ = change;
+    open_ = true;
+    written_ = 0;
+    first_ = last_ = at;
+  }
+  ++written_;
+  first_ = std::min(first_, at);
+  last_ = std::max(last_, at);
+  if (written_ >= members_.size()) Finish();
+}
+
+void Lockstep::Finish() {
+  open_ = false;
+  if (written_ < 2) return;
+  skew_.Record(last_ - first_);
+  if (written_ < members_.size())
+    partial_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void Lockstep::Report(StatsReport *out) const {
+  skew_.Report("skew", out);
+  (*out)["partial"] = partial_.load(std::memory_order_relaxed);
+  absl::MutexLock l(&lock_);
+  (*out)["members"] = members_.size();
+}
+}  // namespace jjaro
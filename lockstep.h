@@ -0,0 +1,62 @@
+#ifndef JJARO_LOCKSTEP_H_
+#define JJARO_LOCKSTEP_H_ 1
+#include <absl/base/thread_annotations.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "control.h"
+#include "stats.h"
+
+namespace jjaro {
+// Lines up the first write toward each new target across outputs, so that
+// monitors change together rather than each whenever its own bus frees up.
+// Controls on one bus already take turns through their shared `DDCPacer`;
+// this lets every bus go at once, no sooner than the slowest is ready.
+class Lockstep {
+ public:
+  // The longest any output is held back for the others.
+  static constexpr absl::Duration kMaxHold = absl::Milliseconds(100);
+
+  Lockstep() = default;
+  Lockstep(const Lockstep &) = delete;
+  Lockstep &operator=(const Lockstep &) = delete;
+
+  // `control` must stay alive until it's passed to `Leave`.  Leaving twice is
+  // harmless.
+  void Join(const Control *control);
+  void Leave(const Control *control);
+  // When to send the first write toward a new target that's ready to go at
+  // `now`: once every member's bus will take a command, or `kMaxHold` from
+  // `now` if that's sooner.
+  absl::Time ReleaseAt(absl::Time now) const;
+  // Notes that a member's first write toward target change `change`, as in
+  // `State::target_changes`, finished at `at`.  A change's skew is recorded
+  // once every member has written it, or, if any two did, once a newer one
+  // comes along.
+  void Applied(uint64_t change, absl::Time at);
+  // Adds the skew between the first and last write of each change to `out`.
+  void Report(StatsReport *out) const;
+
+ private:
+  void Finish() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  mutable absl::Mutex lock_;
+  std::vector<const Control *> members_ ABSL_GUARDED_BY(lock_);
+  // The newest change written, whether its skew is still to be recorded, how
+  // many members have written it, and when the first and last of those
+  // finished.
+  uint64_t change_ ABSL_GUARDED_BY(lock_) = 0;
+  bool open_ ABSL_GUARDED_BY(lock_) = false;
+  size_t written_ ABSL_GUARDED_BY(lock_) = 0;
+  absl::Time first_ ABSL_GUARDED_BY(lock_), last_ ABSL_GUARDED_BY(lock_);
+  LatencyHistogram skew_;
+  // Changes that not every member wrote before the next came along.
+  std::atomic<uint64_t> partial_ = 0;
+};
+}  // namespace jjaro
+#endif  // JJARO_LOCKSTEP_H_
@@ -7,20 +7,34 @@
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstddef>
 #include <optional>
 #include <string>
 
 #include "fd-holder.h"
 
 namespace jjaro {
-absl::StatusOr<FDHolder> Open(const char *pathname, int flags) {
+absl::StatusOr<FDHolder> Open(const char *pathname, int flags, mode_t mode) {
   while (true) {
-    const int ret = open(pathname, flags);
+    const int ret = open(pathname, flags, mode);
     if (ret == -1 && errno == EINTR) continue;
     if (ret == -1) return absl::ErrnoToStatus(errno, "open failed");
     return FDHolder(ret);
   }
 }
+absl::StatusOr<std::string> ReadStr(int fd, size_t max_size) {
+  std::string buf(max_size, '0');
+  size_t len = 0;
+  while (len < buf.size()) {
+    const ssize_t rret = read(fd, buf.data() + len, buf.size() - len);
+    if (rret < 0 && errno == EINTR) continue;
+    if (rret < 0) return absl::ErrnoToStatus(errno, "read failed");
+    if (rret == 0) break;
+    len += rret;
+  }
+  buf.resize(len);
+  return buf;
+}
 absl::StatusOr<std::optional<std::string>> Readlink(const char *pathname) {
   std::string buf(256, '0');
   while (true) {
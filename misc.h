@@ -2,17 +2,24 @@
 #define JJARO_MISC_H_ 1
 
 #include <absl/status/statusor.h>
+#include <sys/types.h>
 
+#include <cstddef>
 #include <optional>
 #include <string>
 
 #include "fd-holder.h"
 
 namespace jjaro {
-absl::StatusOr<FDHolder> Open(const char *pathname, int flags);
-inline absl::StatusOr<FDHolder> Open(const std::string &pathname, int flags) {
-  return Open(pathname.c_str(), flags);
+absl::StatusOr<FDHolder> Open(const char *pathname, int flags,
+                               mode_t mode = 0);
+inline absl::StatusOr<FDHolder> Open(const std::string &pathname, int flags,
+                                      mode_t mode = 0) {
+  return Open(pathname.c_str(), flags, mode);
 }
+// Reads until EOF or `max_size`, since sysfs hands out binary attributes like
+// `edid` a page at a time.
+absl::StatusOr<std::string> ReadStr(int fd, size_t max_size);
 absl::StatusOr<std::optional<std::string>> Readlink(const char *pathname);
 inline absl::StatusOr<std::optional<std::string>> Readlink(
     const std::string &pathname) {
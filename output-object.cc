@@ -0,0 +1,76 @@
+#include "output-object.h"
+
+#include <absl/functional/any_invocable.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+#include <absl/types/span.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "brightness.h"
+#include "output.h"
+
+namespace jjaro {
+
+OutputObject::OutputObject(sdbus::IConnection& connection,
+                           sdbus::ObjectPath objectPath, State* state,
+                           Prober* prober, Lockstep* lockstep,
+                           const Enumerator* enumerator,
+                           uint32_t name, uint32_t version,
+                           absl::Duration reconcile_interval,
+                           absl::AnyInvocable<void()> changed,
+                           absl::AnyInvocable<void(absl::string_view output,
+                                                   int level)>
+                               drifted)
+    : AdaptorInterfaces(connection, std::move(objectPath)),
+      changed_(std::move(changed)) {
+  registerAdaptor();
+  // Only once registered, since probing may finish at any point after this.
+  output_.emplace(state, prober, lockstep, enumerator, name, version,
+                  reconcile_interval,
+                  [this](absl::Span<const char* const> fields) {
+                    getObject().emitPropertiesChangedSignal(
+                        INTERFACE_NAME, std::vector<sdbus::PropertyName>(
+                                            fields.begin(), fields.end()));
+                    changed_();
+                  },
+                  std::move(drifted));
+}
+// Unregistering first stops property reads reaching an output being torn
+// down.  A change it signals on the way out just goes to no one.
+OutputObject::~OutputObject() {
+  Unregister();
+  output_.reset();
+}
+void OutputObject::Unregister() {
+  if (!registered_) return;
+  registered_ = false;
+  unregisterAdaptor();
+  output_->StopListening();
+}
+
+// Unknown values are empty, or -1 for percentages and levels.
+std::string OutputObject::name() { return output_->info().name; }
+std::string OutputObject::make() { return output_->info().make; }
+std::string OutputObject::model() { return output_->info().model; }
+std::string OutputObject::backend() { return output_->info().backend; }
+std::string OutputObject::device() { return output_->info().device; }
+int64_t OutputObject::target() {
+  const auto target = output_->info().target;
+  return target ? PercentFromLevel(*target) : -1;
+}
+int64_t OutputObject::applied() {
+  const auto applied = output_->info().applied;
+  return applied ? PercentFromLevel(*applied) : -1;
+}
+int64_t OutputObject::target_level() {
+  return output_->info().target.value_or(-1);
+}
+int64_t OutputObject::applied_level() {
+  return output_->info().applied.value_or(-1);
+}
+
+}  // namespace jjaro
@@ -0,0 +1,63 @@
+#ifndef JJARO_OUTPUT_OBJECT_H_
+#define JJARO_OUTPUT_OBJECT_H_ 1
+
+#include <absl/functional/any_invocable.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+#include <sdbus-c++/AdaptorInterfaces.h>
+#include <sdbus-c++/IConnection.h>
+#include <sdbus-c++/Types.h>
+
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#include "ddclight-server-glue.h"
+#include "enumerate.h"
+#include "lockstep.h"
+#include "output.h"
+#include "prober.h"
+#include "state.h"
+
+namespace jjaro {
+
+// One `Output`, as its own D-Bus object below the daemon's.
+class OutputObject final
+    : public sdbus::AdaptorInterfaces<org::jjaro::DDCLight::Output_adaptor> {
+ public:
+  // `changed` is called after every property change is signalled, from
+  // whichever thread made it.  `reconcile_interval` and `drifted` are as for
+  // `Output`.
+  OutputObject(sdbus::IConnection& connection, sdbus::ObjectPath objectPath,
+               State* state, Prober* prober, Lockstep* lockstep,
+               const Enumerator* enumerator, uint32_t name, uint32_t version,
+               absl::Duration reconcile_interval,
+               absl::AnyInvocable<void()> changed,
+               absl::AnyInvocable<void(absl::string_view output, int level)>
+                   drifted);
+  ~OutputObject();
+  // Stops serving D-Bus and Wayland, on the `Reactor` thread, so the rest of
+  // the teardown can happen on any thread.
+  void Unregister();
+  uint32_t wayland_name() const { return output_->wayland_name(); }
+  const Output& output() const { return *output_; }
+  Output& output() { return *output_; }
+
+ private:
+  std::string name() override;
+  std::string make() override;
+  std::string model() override;
+  std::string backend() override;
+  std::string device() override;
+  int64_t target() override;
+  int64_t applied() override;
+  int64_t target_level() override;
+  int64_t applied_level() override;
+
+  absl::AnyInvocable<void()> changed_;
+  bool registered_ = true;
+  std::optional<Output> output_;
+};
+
+}  // namespace jjaro
+#endif  // JJARO_OUTPUT_OBJECT_H_
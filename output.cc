@@ -3,20 +3,49 @@
 #include <absl/functional/function_ref.h>
 #include <absl/status/status.h>
 #include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <absl/synchronization/mutex.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <absl/types/span.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <wayland-util.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <map>
+#include <memory>
 #include <optional>
+#include <string>
 #include <tuple>
 #include <utility>
+#include <vector>
+
+#include "brightness.h"
+#include "reconcile-schedule.h"
+#include "trace.h"
 
 namespace jjaro {
-Output::Output(State *state, const Enumerator *enumerator, uint32_t name,
-               uint32_t version)
-    : wayland_name_(name), state_(state) {
+Output::Output(
+    State *state, Prober *prober, Lockstep *lockstep,
+    const Enumerator *enumerator, uint32_t name, uint32_t version,
+    absl::Duration reconcile_interval,
+    absl::AnyInvocable<void(absl::Span<const char *const> fields)> changed,
+    absl::AnyInvocable<void(absl::string_view output, int level)> drifted)
+    : wayland_name_(name),
+      state_(state),
+      prober_(prober),
+      lockstep_(lockstep),
+      reconcile_interval_(reconcile_interval),
+      changed_(std::move(changed)),
+      drifted_(std::move(drifted)) {
+  state_->Subscribe(&waker_);
+  if (!enumerator) return;
   output_.reset(static_cast<struct wl_output *>(wl_registry_bind(
       enumerator->registry(), name, &wl_output_interface,
       std::min<uint32_t>(wl_output_interface.version, version))));
@@ -35,64 +64,383 @@ Output::Output(State *state, const Enumerator *enumerator, uint32_t name,
                   name, ret);
   }
 }
-// This is either run from the `Enumerator::WaylandThreadLoop` thread or from
-// the main thread after that thread has been joined, so there's no race on
-// `thread_` nor any concern about clearning `cancel_` between the set here and
-// the read inside `thread_`.
+// This runs on a `Prober` worker for outputs that went away, or on the
+// `Reactor` thread as the daemon shuts down.  Cancelling our probe first means
+// no worker can be in `InstallControl`, so there's no race on `thread_` nor
+// any concern about clearing `cancel_` between the set in `StopThread` and the
+// read inside `thread_`.
 Output::~Output() {
+  prober_->Cancel(this);
+  StopThread();
+  state_->Unsubscribe(&waker_);
+}
+
+void Output::StopThread() {
+  if (watch_thread_) {
+    const uint64_t one = 1;
+    while (write(watch_stop_fd_.get(), &one, sizeof(one)) < 0 &&
+           errno == EINTR) {
+    }
+    watch_thread_->join();
+    watch_thread_.reset();
+  }
   if (!thread_) return;
+  cancel_.store(true, std::memory_order_relaxed);
+  waker_.Wake();
+  thread_->join();
+  thread_.reset();
+  lockstep_->Leave(control_.get());
+}
+
+Output::Info Output::info() const {
+  absl::MutexLock l(&info_lock_);
+  return info_;
+}
+
+void Output::ReportStats(StatsReport *out) const {
+  stats_.Report(out);
+  absl::MutexLock l(&info_lock_);
+  if (control_) control_->stats().Report(out);
+}
+
+// Levels are published as they are and to the nearest percent, which changes
+// less often.
+void Output::Publish(std::optional<int> target, std::optional<int> applied) {
+  const auto percent = [](std::optional<int> level) -> std::optional<int> {
+    if (!level) return std::nullopt;
+    return PercentFromLevel(*level);
+  };
+  const char *fields[4];
+  size_t changed = 0;
   {
-    absl::MutexLock l(&state_->lock);
-    cancel_.store(true, std::memory_order_relaxed);
+    absl::MutexLock l(&info_lock_);
+    if (info_.target != target) fields[changed++] = "target_level";
+    if (percent(info_.target) != percent(target)) fields[changed++] = "target";
+    if (info_.applied != applied) fields[changed++] = "applied_level";
+    if (percent(info_.applied) != percent(applied))
+      fields[changed++] = "applied";
+    info_.target = target;
+    info_.applied = applied;
   }
-  thread_->join();
+  if (changed) changed_(absl::MakeConstSpan(fields, changed));
 }
 
 void Output::ThreadLoop(Output *that) {
   constexpr auto kRetryInterval = absl::Minutes(1);
-  int last_desired_percentage;
+  // How long the target has to hold still before writes get read back.
+  constexpr auto kVerifyIdleTime = absl::Seconds(2);
+  // Nothing's gained by fading faster than the display refreshes.
+  constexpr auto kFrameInterval = absl::Microseconds(16667);
+  // The slowest that outputs keep reading back once they've drifted.
+  constexpr auto kMaxReconcileInterval = absl::Minutes(5);
+  int last_desired_level;
+  std::optional<int> target;
+  TraceThreadName(absl::StrCat("output ", that->name_));
   {
-    absl::MutexLock l(&that->state_->lock);
-    if (!that->state_->desired_percentage.has_value()) {
+    StateUpdate u(that->state_);
+    if (!that->state_->desired_level.has_value()) {
       int try_count = 0;
-      that->state_->desired_percentage =
+      that->state_->desired_level =
           that->control_
-              ->GetBrightnessPercent(
+              ->GetBrightnessLevel(
                   [&try_count]() -> bool { return try_count++; })
-              .value_or(50);
+              .value_or(kMaxBrightnessLevel / 2);
+      u.Changed();
     }
-    last_desired_percentage = that->state_->desired_percentage.value_or(50);
+    target = that->state_->DesiredFor(that->name_);
+    last_desired_level = target.value_or(kMaxBrightnessLevel / 2);
   }
-  while (true) {
-    const auto ss = that->control_->SetBrightnessPercent(
-        last_desired_percentage,
-        [that] { return that->cancel_.load(std::memory_order_relaxed); });
+  // The `State::target_changes` as of the last write and the last hold for
+  // the other outputs, and when the newest target that a write has reached
+  // was set.
+  uint64_t target_changes, written_target_changes, held_target_changes;
+  absl::Time target_changed_at, reached_target_changed_at;
+  {
     absl::MutexLock l(&that->state_->lock);
+    target_changes = written_target_changes = held_target_changes =
+        that->state_->target_changes;
+    target_changed_at = reached_target_changed_at =
+        that->state_->target_changed_at;
+  }
+  bool verify = false;
+  // How long a set takes, and how often this control can take one, as of the
+  // last set.  These decide how finely a fade gets stepped.
+  absl::Duration step_cost = absl::ZeroDuration();
+  absl::Duration step_interval = kFrameInterval;
+  absl::Time next_step = absl::InfinitePast();
+  absl::Time held_until = absl::InfinitePast();
+  // The VCP feature values this control has been sent.
+  std::map<uint8_t, uint16_t> written_features;
+  // Controls that report changes need no polling to find them.
+  ReconcileSchedule reconcile(that->control_->reports_changes()
+                                  ? absl::ZeroDuration()
+                                  : that->reconcile_interval_,
+                              kMaxReconcileInterval);
+  while (true) {
+    const auto cancel = [that] {
+      return that->cancel_.load(std::memory_order_relaxed);
+    };
+    std::vector<std::pair<uint8_t, uint16_t>> features;
+    bool set_brightness = !verify;
+    if (!verify) {
+      // Hold off until the bus will take the command, then send the newest
+      // target rather than one that's gone stale while waiting.
+      if (that->WaitForDeadlineOrCancel(std::max(
+              {that->control_->next_command_time(), next_step, held_until})))
+        return;
+      absl::MutexLock l(&that->state_->lock);
+      last_desired_level = that->NextStep(step_cost, step_interval);
+      target = that->state_->DesiredFor(that->name_);
+      target_changes = that->state_->target_changes;
+      target_changed_at = that->state_->target_changed_at;
+      // A new target goes out on every output at once, once the busiest bus
+      // is free, so hold this one back for that the first time round.
+      if (target_changes != held_target_changes) {
+        held_target_changes = target_changes;
+        held_until = that->lockstep_->ReleaseAt(absl::Now());
+        if (held_until > absl::Now()) continue;
+      }
+      features = that->DirtyFeatures(written_features);
+      // Waking for a feature leaves brightness be, and partway through a
+      // slow fade, most frames don't move far enough to change the device's
+      // raw value.  Landing on the target still goes through the control,
+      // which writes nothing, so the level it reports is the target's.
+      if (that->control_->IsCurrentLevel(last_desired_level)) {
+        if (features.empty() && last_desired_level != target) {
+          next_step = absl::Now() + kFrameInterval;
+          continue;
+        }
+        set_brightness =
+            that->control_->cached_brightness_level().value_or(-1) !=
+            last_desired_level;
+      }
+    }
+    // Covers the work of one pass, but none of the waiting between them.
+    TraceScope step(verify ? "Output::ThreadLoop verify"
+                           : "Output::ThreadLoop");
+    step.Arg("level", last_desired_level);
+    step.Arg("features", features.size());
+    for (const auto &[code, value] : features) {
+      const auto fs = that->control_->SetVCPFeature(code, value, cancel);
+#ifndef NDEBUG
+      if (!fs.ok())
+        absl::FPrintF(stderr,
+                      "Failed to set VCP feature 0x%02x to %d on output %s "
+                      "(%s:%s) %s: %s\n",
+                      code, value, that->name_, that->make_, that->model_,
+                      that->control_->name(), fs.ToString());
+#endif
+      // Failures aren't retried until the value changes again; most mean the
+      // monitor doesn't have the feature at all.
+      written_features.insert_or_assign(code, value);
+    }
+    absl::Status ss;
+    if (verify) {
+      ss = that->control_->VerifyBrightness(cancel);
+      // That was a read-back too, and found the control where it was left.
+      if (ss.ok()) reconcile.Polled(absl::Now(), false);
+    } else if (set_brightness) {
+      // A level on the step the device is already at only updates what the
+      // control reports, so there's no write to count or time.
+      const bool writes = !that->control_->IsCurrentLevel(last_desired_level);
+      const absl::Time started = absl::Now();
+      ss = that->control_->SetBrightnessLevel(last_desired_level, cancel);
+      if (ss.ok() && !writes) {
+        written_target_changes = target_changes;
+      } else if (ss.ok()) {
+        const absl::Time now = absl::Now();
+        if (target_changes != written_target_changes)
+          that->lockstep_->Applied(target_changes, now);
+        that->RecordWrite(now, last_desired_level == target,
+                          target_changes, target_changed_at,
+                          &written_target_changes, &reached_target_changed_at);
+        reconcile.Activity(now);
+        step_cost = now - started;
+        step_interval = std::max(
+            that->control_->next_command_time() - started, kFrameInterval);
+        next_step = started + step_interval;
+      }
+    }
     if (ss.ok()) {
-      if (that->WaitForNewTargetOrCancel(kRetryInterval)) return;
-      last_desired_percentage = that->state_->desired_percentage.value_or(50);
+      const auto applied = that->control_->cached_brightness_level();
+      that->Publish(target, applied.ok() ? std::optional<int>(*applied)
+                                         : std::nullopt);
+    }
+    step.End();
+    verify = false;
+    if (ss.ok()) {
+      if (that->control_->has_unverified_write() &&
+          !that->WaitForNewTargetOrTimeout(kVerifyIdleTime)) {
+        verify = true;
+        continue;
+      }
+      while (true) {
+        if (that->reported_change_.exchange(false,
+                                            std::memory_order_relaxed)) {
+          that->stats_.reported_changes.fetch_add(1,
+                                                  std::memory_order_relaxed);
+          that->Reconcile(cancel);
+        }
+        if (reconcile.next() == absl::InfiniteFuture()) {
+          if (that->WaitForNewTargetOrCancel(kRetryInterval)) return;
+        } else if (!that->WaitForNewTargetOrTimeout(reconcile.next() -
+                                                    absl::Now())) {
+          reconcile.Polled(absl::Now(), that->Reconcile(cancel));
+          continue;
+        }
+        if (!that->reported_change_.load(std::memory_order_relaxed)) break;
+      }
     } else {
+      that->stats_.failures.fetch_add(1, std::memory_order_relaxed);
 #ifndef NDEBUG
       absl::FPrintF(stderr,
-                    "Failed to set brightness to %d on output %s (%s:%s) %s: "
-                    "%s\nWill retry in %v.\n",
-                    last_desired_percentage, that->name_, that->make_,
+                    "Failed to set brightness to level %d on output %s "
+                    "(%s:%s) %s: %s\nWill retry in %v.\n",
+                    last_desired_level, that->name_, that->make_,
                     that->model_, that->control_->name(), ss.ToString(),
                     absl::FormatDuration(kRetryInterval));
 #endif
-      if (that->WaitForDurationOrCancel(kRetryInterval)) return;
+      // A change the control reported would otherwise end the wait at once.
+      if (that->reported_change_.exchange(false, std::memory_order_relaxed)) {
+        that->stats_.reported_changes.fetch_add(1, std::memory_order_relaxed);
+        that->Reconcile(cancel);
+      }
+      // The level that failed is still cached as the old one, so wait on the
+      // target itself: a new one is tried at once, and this one again later.
+      that->WaitUntil(absl::Now() + kRetryInterval,
+                      target.value_or(last_desired_level));
+      if (cancel()) return;
+    }
+  }
+}
+
+void Output::WatchLoop(Output *that) {
+  TraceThreadName(absl::StrCat("output watch ", that->name_));
+  while (true) {
+    const auto ws = that->control_->WaitForChange(that->watch_stop_fd_.get());
+    if (absl::IsCancelled(ws)) return;
+    if (!ws.ok()) {
+      absl::FPrintF(stderr,
+                    "Not watching output %s (%s:%s) %s for changes: %s.\n",
+                    that->name_, that->make_, that->model_,
+                    that->control_->name(), ws.ToString());
+      return;
+    }
+    that->reported_change_.store(true, std::memory_order_relaxed);
+    that->waker_.Wake();
+  }
+}
+
+// Counts a brightness write that finished at `now`, as of `target_changes`.
+// Every change to the target since the last write is one the output never
+// got to see through; and the first write to reach a target, `reached`, is
+// how long it took to get there from `target_changed_at`.
+void Output::RecordWrite(absl::Time now, bool reached, uint64_t target_changes,
+                         absl::Time target_changed_at,
+                         uint64_t *written_target_changes,
+                         absl::Time *reached_target_changed_at) {
+  stats_.writes.fetch_add(1, std::memory_order_relaxed);
+  if (target_changes > *written_target_changes + 1) {
+    const uint64_t skipped = target_changes - *written_target_changes - 1;
+    stats_.coalesced.fetch_add(skipped, std::memory_order_relaxed);
+    TraceInstant("coalesced", "targets", skipped);
+  }
+  *written_target_changes = target_changes;
+  if (!reached || target_changed_at == *reached_target_changed_at) return;
+  stats_.target_to_write.Record(now - target_changed_at);
+  *reached_target_changed_at = target_changed_at;
+}
+
+// Picks what to send now so that it's right when it lands, `cost` from now.
+// If the step after it would land past the end of a fade, this one goes
+// straight to the target instead, so that every output gets there by the
+// deadline however coarsely it has to step.
+int Output::NextStep(absl::Duration cost, absl::Duration interval) const {
+  absl::Time lands = absl::Now() + cost;
+  if (state_->transition && lands + interval > state_->transition->end)
+    lands = state_->transition->end;
+  return state_->TargetAt(lands, name_);
+}
+
+// Reads the control back, and if it's been moved from where this left it,
+// takes where it is now as this output's own target, as `setmany` would set
+// it, so it isn't put back.  Returns whether it had been moved.
+bool Output::Reconcile(absl::FunctionRef<bool()> cancel) {
+  const auto before = control_->cached_brightness_level();
+  if (!before.ok()) return false;
+  TraceScope trace("Output::Reconcile");
+  const auto moved = control_->ReadBackMoved(cancel);
+  stats_.reconcile_reads.fetch_add(1, std::memory_order_relaxed);
+  if (!moved.ok() || !*moved) return false;
+  const auto level = control_->cached_brightness_level();
+  trace.Arg("level", *level);
+  stats_.drifts.fetch_add(1, std::memory_order_relaxed);
+  {
+    StateUpdate u(state_);
+    // A target that came in since wins over this.
+    if (state_->DesiredFor(name_) != *before) return true;
+    state_->output_levels.insert_or_assign(name_, *level);
+    u.Changed();
+  }
+  Publish(*level, *level);
+  drifted_(name_, *level);
+  return true;
+}
+
+// Picks out the VCP features whose latest values haven't been sent to this
+// output's control yet, as far as `written` knows.
+std::vector<std::pair<uint8_t, uint16_t>> Output::DirtyFeatures(
+    const std::map<uint8_t, uint16_t> &written) {
+  vcp_seen_ = state_->vcp_generation;
+  std::vector<std::pair<uint8_t, uint16_t>> ret;
+  for (const auto &[code, value] : state_->vcp_features)
+    if (const auto it = written.find(code);
+        it == written.end() || it->second != value)
+      ret.emplace_back(code, value);
+  return ret;
+}
+
+// True if the target or a VCP feature moved since the output got to `current`.
+// `idle_generation` is the `State::generation` this last found nothing new as
+// of; while that still holds, there's no need to look again.
+bool Output::HasNewTarget(int current, uint64_t *idle_generation) {
+  const uint64_t generation =
+      state_->generation.load(std::memory_order_acquire);
+  if (generation == *idle_generation) return false;
+  absl::MutexLock l(&state_->lock);
+  if (state_->DesiredFor(name_) != current ||
+      state_->vcp_generation != vcp_seen_)
+    return true;
+  *idle_generation = generation;
+  return false;
+}
+
+// Waits for `deadline`, a cancellation, or, given the `current` level, a
+// new target or a change the control reported.  Returns false if it got to
+// `deadline`.
+bool Output::WaitUntil(absl::Time deadline, std::optional<int> current) {
+  uint64_t idle_generation = ~uint64_t{0};
+  while (true) {
+    const uint32_t seq = waker_.seq();
+    if (cancel_.load(std::memory_order_relaxed) ||
+        (current && (reported_change_.load(std::memory_order_relaxed) ||
+                     HasNewTarget(*current, &idle_generation))))
+      return true;
+    const bool woken = waker_.WaitUntil(seq, deadline);
+    // However this woke, it may be where `State::WakeAfter` left off.
+    if (const uint64_t generation = state_->generation.load();
+        generation != relayed_generation_) {
+      relayed_generation_ = generation;
+      state_->WakeAfter(&waker_);
     }
+    if (!woken) return false;
   }
 }
 
 bool Output::WaitForNewTargetOrCancel(absl::Duration d) {
-  const auto current_percent = control_->cached_brightness_percent();
-  if (current_percent.ok()) {
-    auto cond = [this, old = *current_percent] {
-      return cancel_.load(std::memory_order_relaxed) ||
-             state_->desired_percentage != old;
-    };
-    state_->lock.Await(absl::Condition(&cond));
+  const auto current_level = control_->cached_brightness_level();
+  if (current_level.ok()) {
+    WaitUntil(absl::InfiniteFuture(), *current_level);
     return cancel_.load(std::memory_order_relaxed);
   } else {
 #ifndef NDEBUG
@@ -100,15 +448,26 @@ bool Output::WaitForNewTargetOrCancel(absl::Duration d) {
                   "Failed to get brightness on output %s (%s:%s) %s: %s\nWill "
                   "retry in %v.\n",
                   name_, make_, model_, control_->name(),
-                  current_percent.status().ToString(), absl::FormatDuration(d));
+                  current_level.status().ToString(), absl::FormatDuration(d));
 #endif
     return WaitForDurationOrCancel(d);
   }
 }
 
+// Returns true if a new target or a cancellation came within `d`, and false if
+// it timed out.
+bool Output::WaitForNewTargetOrTimeout(absl::Duration d) {
+  const auto current_level = control_->cached_brightness_level();
+  if (!current_level.ok()) return true;
+  return WaitUntil(absl::Now() + d, *current_level);
+}
+
 bool Output::WaitForDurationOrCancel(absl::Duration d) {
-  auto cond = [this] { return cancel_.load(std::memory_order_relaxed); };
-  state_->lock.AwaitWithTimeout(absl::Condition(&cond), d);
+  return WaitForDeadlineOrCancel(absl::Now() + d);
+}
+
+bool Output::WaitForDeadlineOrCancel(absl::Time t) {
+  WaitUntil(t, std::nullopt);
   return cancel_.load(std::memory_order_relaxed);
 }
 
@@ -123,37 +482,104 @@ void Output::HandleMode(void *, struct wl_output *, uint32_t, int32_t, int32_t,
                         int32_t) {}
 void Output::HandleDone(void *output, struct wl_output *) {
   auto that = static_cast<Output *>(output);
-  if (std::tie(that->make_, that->model_, that->name_) ==
+  if (std::tie(that->requested_make_, that->requested_model_,
+               that->requested_name_) ==
       std::tie(that->new_make_, that->new_model_, that->new_name_))
     return;
-  if (that->thread_) {
-    {
-      absl::MutexLock l(&that->state_->lock);
-      that->cancel_.store(true, std::memory_order_relaxed);
-    }
-    that->thread_->join();
+  that->requested_make_ = std::move(that->new_make_);
+  that->requested_model_ = std::move(that->new_model_);
+  that->requested_name_ = std::move(that->new_name_);
+  that->Reprobe();
+}
+void Output::StopListening() { output_.reset(); }
+void Output::Reprobe() {
+  if (requested_name_.empty()) return;
+  // Any probe still queued is stale.  One already running may be waiting on
+  // a slow monitor, so rather than wait for it here, let it finish and
+  // install whatever it found; the fresh one runs after it and replaces it.
+  prober_->Drop(this);
+  prober_->Probe(this, requested_name_,
+                 [this, make = requested_make_, model = requested_model_,
+                  name = requested_name_](
+                     absl::StatusOr<std::unique_ptr<Control>> ctrl) mutable {
+                   InstallControl(std::move(make), std::move(model),
+                                  std::move(name), std::move(ctrl));
+                 });
+}
+void Output::ProbeDevice(std::string device) {
+  if (requested_name_.empty()) return;
+  // This runs after any probe already queued, so a control found by one of
+  // those, perhaps on this very bus, leaves nothing to do.
+  prober_->Probe(
+      this, requested_name_,
+      [this, device = std::move(device)](
+          absl::string_view output,
+          const ProbeContext &ctx) -> absl::StatusOr<std::unique_ptr<Control>> {
+        if (control_)
+          return absl::AlreadyExistsError(
+              absl::StrCat(output, " already has a control"));
+        return Control::ProbeI2CDevice(output, device, ctx);
+      },
+      [this, make = requested_make_, model = requested_model_,
+       name = requested_name_](
+          absl::StatusOr<std::unique_ptr<Control>> ctrl) mutable {
+        if (!ctrl.ok()) {
+#ifndef NDEBUG
+          absl::FPrintF(stderr, "No new control for output %s: %s.\n", name,
+                        ctrl.status().ToString());
+#endif
+          return;
+        }
+        InstallControl(std::move(make), std::move(model), std::move(name),
+                       std::move(ctrl));
+      });
+}
+void Output::Install(std::string name, std::unique_ptr<Control> control) {
+  InstallControl("", "", std::move(name), std::move(control));
+}
+// Runs on a `Prober` worker thread.
+void Output::InstallControl(std::string make, std::string model,
+                            std::string name,
+                            absl::StatusOr<std::unique_ptr<Control>> ctrl) {
+  StopThread();
+  make_ = std::move(make);
+  model_ = std::move(model);
+  name_ = std::move(name);
+  {
+    absl::MutexLock l(&info_lock_);
+    info_ = {.name = name_,
+             .make = make_,
+             .model = model_,
+             .backend = ctrl.ok() ? std::string((*ctrl)->backend()) : "",
+             .device = ctrl.ok() ? std::string((*ctrl)->name()) : ""};
   }
-  that->make_ = std::move(that->new_make_);
-  that->model_ = std::move(that->new_model_);
-  that->name_ = std::move(that->new_name_);
-  if (auto ctrl = Control::Probe(that->name_); ctrl.ok()) {
-    that->control_ = *std::move(ctrl);
+  static constexpr const char *kFields[] = {
+      "name",   "make",    "model",        "backend",      "device",
+      "target", "applied", "target_level", "applied_level"};
+  changed_(kFields);
+  if (ctrl.ok()) {
     {
-      absl::MutexLock l(&that->state_->lock);
-      that->cancel_.store(false, std::memory_order_relaxed);
+      absl::MutexLock l(&info_lock_);
+      control_ = *std::move(ctrl);
+    }
+    cancel_.store(false, std::memory_order_relaxed);
+    reported_change_.store(false, std::memory_order_relaxed);
+    lockstep_->Join(control_.get());
+    thread_.emplace(ThreadLoop, this);
+    if (control_->reports_changes()) {
+      watch_stop_fd_ = FDHolder(eventfd(0, EFD_CLOEXEC));
+      if (watch_stop_fd_.get() != -1) watch_thread_.emplace(WatchLoop, this);
     }
-    that->thread_.emplace(ThreadLoop, that);
     absl::FPrintF(stderr, "Watching controls for output %s (%s:%s) %s.\n",
-                  that->name_, that->make_, that->model_,
-                  that->control_->name());
+                  name_, make_, model_, control_->name());
   } else {
     absl::FPrintF(
         stderr,
         "Failed to find brightness control for output %s (%s:%s); won't "
         "adjust: %s.\n",
-        that->name_, that->make_, that->model_, ctrl.status().ToString());
-    that->control_.reset();
-    that->thread_.reset();
+        name_, make_, model_, ctrl.status().ToString());
+    absl::MutexLock l(&info_lock_);
+    control_.reset();
   }
 }
 void Output::HandleScale(void *, struct wl_output *, int32_t) {}
@@ -1,31 +1,85 @@
 #ifndef JJARO_OUTPUT_H_
 #define JJARO_OUTPUT_H_ 1
 
+#include <absl/base/thread_annotations.h>
+#include <absl/functional/any_invocable.h>
+#include <absl/functional/function_ref.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
 #include <absl/time/time.h>
+#include <absl/types/span.h>
 #include <wayland-client-protocol.h>
 
 #include <atomic>
 #include <cstdint>
+#include <map>
 #include <memory>
 #include <optional>
 #include <string>
 #include <thread>
+#include <utility>
+#include <vector>
 
 #include "control.h"
 #include "deleter.h"
 #include "enumerate.h"
+#include "fd-holder.h"
+#include "lockstep.h"
+#include "prober.h"
 #include "state.h"
+#include "stats.h"
+#include "waker.h"
 
 namespace jjaro {
 class Output {
  public:
-  Output(State *state, const Enumerator *enumerator, uint32_t name,
-         uint32_t version);
+  // What's known about an output and its control, for showing to clients.
+  struct Info {
+    std::string name, make, model, backend;
+    // The control's device, as in i2c-3 or intel_backlight.
+    std::string device;
+    // The level it's headed for, and the last one written to it.
+    std::optional<int> target, applied;
+  };
+
+  // `changed` is called with the names of the `Info` fields that changed,
+  // from whichever thread changed them.  Outputs read their brightness back
+  // when their control reports a change, or otherwise on a
+  // `ReconcileSchedule` starting from `reconcile_interval`, and once they
+  // find something else has changed it, make that their own target in
+  // `state` and call `drifted` from their own thread.  Their controls join
+  // `lockstep` while they have them.  Without an `enumerator`, an output
+  // isn't bound to Wayland, and only gets a control through `Install`.
+  Output(State *state, Prober *prober, Lockstep *lockstep,
+         const Enumerator *enumerator, uint32_t name, uint32_t version,
+         absl::Duration reconcile_interval,
+         absl::AnyInvocable<void(absl::Span<const char *const> fields)>
+             changed,
+         absl::AnyInvocable<void(absl::string_view output, int level)>
+             drifted);
   ~Output();
   uint32_t wayland_name() const { return wayland_name_; }
+  Info info() const;
+  // Adds this output's stats, and its control's, to `out`.
+  void ReportStats(StatsReport *out) const;
+  // Has this output follow its target through `control`, as if a probe for
+  // `name` had found it, for outputs not bound to Wayland.  Don't call it
+  // while a probe for this output could be running.
+  void Install(std::string name, std::unique_ptr<Control> control);
+  // Probes this output afresh, as when its control may have gone away.
+  // Only call these on the `Reactor` thread.
+  void Reprobe();
+  // Unbinds from Wayland, ahead of being destroyed off the `Reactor` thread.
+  void StopListening();
+  // Probes only the I2C bus `device`, which has just appeared, for an output
+  // without a control, and installs one found there.  Failures leave the
+  // output as it was.
+  void ProbeDevice(std::string device);
 
  private:
   static void ThreadLoop(Output *that);
+  static void WatchLoop(Output *that);
   static void HandleGeometry(void *output, struct wl_output *, int32_t, int32_t,
                              int32_t, int32_t, int32_t, const char *make,
                              const char *model, int32_t);
@@ -35,8 +89,24 @@ class Output {
   static void HandleScale(void *, struct wl_output *, int32_t);
   static void HandleName(void *output, struct wl_output *, const char *name);
   static void HandleDescription(void *, struct wl_output *, const char *);
+  void InstallControl(std::string make, std::string model, std::string name,
+                      absl::StatusOr<std::unique_ptr<Control>> ctrl);
+  void StopThread();
+  void Publish(std::optional<int> target, std::optional<int> applied);
+  void RecordWrite(absl::Time now, bool reached, uint64_t target_changes,
+                   absl::Time target_changed_at,
+                   uint64_t *written_target_changes,
+                   absl::Time *reached_target_changed_at);
+  int NextStep(absl::Duration cost, absl::Duration interval) const;
+  bool Reconcile(absl::FunctionRef<bool()> cancel);
+  std::vector<std::pair<uint8_t, uint16_t>> DirtyFeatures(
+      const std::map<uint8_t, uint16_t> &written);
+  bool HasNewTarget(int current, uint64_t *idle_generation);
+  bool WaitUntil(absl::Time deadline, std::optional<int> current);
   bool WaitForNewTargetOrCancel(absl::Duration d);
+  bool WaitForNewTargetOrTimeout(absl::Duration d);
   bool WaitForDurationOrCancel(absl::Duration d);
+  bool WaitForDeadlineOrCancel(absl::Time t);
 
   static constexpr struct wl_output_listener kOutputListener{
       .geometry = HandleGeometry,
@@ -47,14 +117,41 @@ class Output {
       .description = HandleDescription};
   uint32_t wayland_name_;
   std::unique_ptr<struct wl_output, Deleter<wl_output_destroy>> output_;
+  // `make_`, `model_`, `name_`, `control_`, and `thread_` are only written by
+  // `InstallControl` on a `Prober` worker, which runs one probe per output at
+  // a time.  `Prober::Cancel` is called before anything else touches them, so
+  // they need no lock of their own, except that `control_` is also written
+  // under `info_lock_` for `ReportStats`.
   std::string make_, model_, name_;
+  // These are only touched on the `Reactor` thread, from Wayland dispatch.
   std::string new_make_, new_model_, new_name_;
+  std::string requested_make_, requested_model_, requested_name_;
   State *state_;
-  // Writes to `cancel_` are guarded by `state_->lock`.  This is necessary to
-  // use that lock to wait on changes to this variable.
+  Prober *prober_;
+  Lockstep *lockstep_;
+  // Set before waking `waker_`, which `thread_` waits on for this as well as
+  // for changes to `state_`.
   std::atomic<bool> cancel_;
+  Waker waker_;
   std::unique_ptr<Control> control_;
   std::optional<std::thread> thread_;
+  // Waits on `control_` for changes it reports, while `thread_` runs, and
+  // sets `reported_change_` for `thread_` to read the brightness back.
+  std::optional<std::thread> watch_thread_;
+  // An eventfd that stops `watch_thread_`.
+  FDHolder watch_stop_fd_;
+  std::atomic<bool> reported_change_ = false;
+  // The `State::vcp_generation` that `thread_` last sent features as of.
+  // Only touched by `thread_`.
+  uint64_t vcp_seen_ = 0;
+  // The last `State::generation` that `thread_` passed a wake on for.
+  uint64_t relayed_generation_ = 0;
+  absl::Duration reconcile_interval_;
+  absl::AnyInvocable<void(absl::Span<const char *const> fields)> changed_;
+  absl::AnyInvocable<void(absl::string_view output, int level)> drifted_;
+  mutable absl::Mutex info_lock_;
+  Info info_ ABSL_GUARDED_BY(info_lock_);
+  OutputStats stats_;
 };
 }  // namespace jjaro
 #endif  // JJARO_OUTPUT_H_
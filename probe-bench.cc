@@ -0,0 +1,172 @@
+// Probe latency over synthetic sysfs trees of growing size.  Besides time,
+// each benchmark reports the syscalls one pass over every output makes,
+// counted by tracing a forked copy of the pass.  DDC/CI monitors are emulated,
+// so their numbers include the control's fixed reply delay but no bus time.
+#include <absl/functional/function_ref.h>
+#include <absl/strings/str_cat.h>
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+
+#include "control.h"
+#include "ddc-emulator.h"
+#include "edid-cache.h"
+#include "probe-cache.h"
+#include "sysfs-fixture.h"
+
+namespace jjaro {
+namespace {
+// Returns the number of syscalls `fn` makes, or -1 if we can't trace.
+double CountSyscalls(absl::FunctionRef<void()> fn) {
+  const pid_t pid = fork();
+  if (pid < 0) return -1;
+  if (pid == 0) {
+    if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) != 0) _exit(EXIT_FAILURE);
+    raise(SIGSTOP);
+    fn();
+    _exit(EXIT_SUCCESS);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) return -1;
+  if (ptrace(PTRACE_SETOPTIONS, pid, nullptr,
+             PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL) != 0) {
+    kill(pid, SIGKILL);
+    waitpid(pid, &status, 0);
+    return -1;
+  }
+  int64_t stops = 0;
+  while (true) {
+    if (ptrace(PTRACE_SYSCALL, pid, nullptr, nullptr) != 0) break;
+    if (waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status)) break;
+    if (WSTOPSIG(status) == (SIGTRAP | 0x80)) stops++;
+  }
+  // Every syscall stops once on entry and once on exit, except the final
+  // `exit_group`, which never returns.
+  return (stops + 1) / 2;
+}
+
+void ProbeAll(const SyntheticSysfs &sysfs, ProbeCache *probe_cache,
+              I2CBusOpener *i2c_opener) {
+  EDIDCache edid_cache;
+  const ProbeContext ctx{.root = sysfs.root(),
+                         .edid_cache = &edid_cache,
+                         .probe_cache = probe_cache,
+                         .i2c_opener = i2c_opener};
+  for (const std::string &output : sysfs.outputs())
+    benchmark::DoNotOptimize(Control::Probe(output, ctx));
+}
+
+void RunProbeBenchmark(benchmark::State &state,
+                       const SyntheticTopology &topology, bool cached) {
+  auto sysfs = SyntheticSysfs::Create(topology);
+  if (!sysfs.ok()) {
+    state.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EmulatedI2CBuses buses;
+  const EmulatedMonitorOptions options{.reply_latency = absl::ZeroDuration()};
+  for (size_t i = 0; i < sysfs->outputs().size(); i++)
+    if (!sysfs->buses()[i].empty())
+      buses.Add(sysfs->buses()[i], sysfs->edids()[i], options);
+  for (const std::string &bus : sysfs->stray_buses())
+    buses.Add(bus, "not the EDID you're looking for", options);
+  std::unique_ptr<ProbeCache> probe_cache;
+  if (cached) {
+    probe_cache = std::make_unique<ProbeCache>(
+        absl::StrCat(sysfs->root(), "/probe-cache"));
+    ProbeAll(*sysfs, probe_cache.get(), &buses);
+  }
+  const double baseline = CountSyscalls([] {});
+  const double syscalls =
+      CountSyscalls([&] { ProbeAll(*sysfs, probe_cache.get(), &buses); }) -
+      baseline;
+  for (auto _ : state) ProbeAll(*sysfs, probe_cache.get(), &buses);
+  const double outputs = sysfs->outputs().size();
+  state.counters["outputs"] = outputs;
+  state.counters["syscalls"] = syscalls;
+  state.counters["syscalls_per_output"] = outputs ? syscalls / outputs : 0;
+}
+
+void BM_ProbeBacklight(benchmark::State &state) {
+  RunProbeBenchmark(state, {.cards = 1, .backlights = int(state.range(0))},
+                    false);
+}
+BENCHMARK(BM_ProbeBacklight)->RangeMultiplier(4)->Range(1, 64);
+
+void BM_ProbeDDCLink(benchmark::State &state) {
+  RunProbeBenchmark(state, {.cards = 1, .ddc_links = int(state.range(0))},
+                    false);
+}
+BENCHMARK(BM_ProbeDDCLink)->RangeMultiplier(4)->Range(1, 16);
+
+void BM_ProbeDPMST(benchmark::State &state) {
+  RunProbeBenchmark(state, {.cards = 1, .dpmst = int(state.range(0))}, false);
+}
+BENCHMARK(BM_ProbeDPMST)->RangeMultiplier(4)->Range(1, 16);
+
+// A laptop panel, a couple of direct outputs, and an MST dock per card.
+void BM_ProbeMixedCards(benchmark::State &state) {
+  RunProbeBenchmark(state,
+                    {.cards = int(state.range(0)),
+                     .backlights = 1,
+                     .ddc_links = 2,
+                     .dpmst = 3,
+                     .stray_dpmst = 1},
+                    false);
+}
+BENCHMARK(BM_ProbeMixedCards)->RangeMultiplier(2)->Range(1, 8);
+
+void BM_ProbeBacklightCached(benchmark::State &state) {
+  RunProbeBenchmark(state, {.cards = 1, .backlights = int(state.range(0))},
+                    true);
+}
+BENCHMARK(BM_ProbeBacklightCached)->RangeMultiplier(4)->Range(1, 64);
+
+// One MST output's bus turning up late behind a dock with `dpmst` outputs, as
+// found by a full probe of that output and by probing the new bus alone, as
+// hotplug events do.
+void BM_ProbeNewBus(benchmark::State &state) {
+  const bool targeted = state.range(0);
+  auto sysfs = SyntheticSysfs::Create({.cards = 1,
+                                       .dpmst = int(state.range(1)),
+                                       .stray_dpmst = 1});
+  if (!sysfs.ok()) {
+    state.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EmulatedI2CBuses buses;
+  const EmulatedMonitorOptions options{.reply_latency = absl::ZeroDuration()};
+  for (size_t i = 0; i < sysfs->outputs().size(); i++)
+    buses.Add(sysfs->buses()[i], sysfs->edids()[i], options);
+  for (const std::string &bus : sysfs->stray_buses())
+    buses.Add(bus, "not the EDID you're looking for", options);
+  const std::string &output = sysfs->outputs().back();
+  const std::string &bus = sysfs->buses().back();
+  const auto probe = [&] {
+    EDIDCache edid_cache;
+    const ProbeContext ctx{.root = sysfs->root(),
+                           .edid_cache = &edid_cache,
+                           .i2c_opener = &buses};
+    benchmark::DoNotOptimize(targeted
+                                 ? Control::ProbeI2CDevice(output, bus, ctx)
+                                 : Control::Probe(output, ctx));
+  };
+  const double baseline = CountSyscalls([] {});
+  state.counters["syscalls"] = CountSyscalls(probe) - baseline;
+  for (auto _ : state) probe();
+}
+BENCHMARK(BM_ProbeNewBus)
+    ->ArgNames({"targeted", "dpmst"})
+    ->ArgsProduct({{0, 1}, {1, 4, 16}});
+}  // namespace
+}  // namespace jjaro
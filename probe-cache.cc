@@ -0,0 +1,153 @@
+#include "probe-cache.h"
+
+#include <absl/status/status.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fd-holder.h"
+#include "misc.h"
+
+namespace jjaro {
+namespace {
+constexpr absl::string_view kHeader = "ddclight-probe-cache 1\n";
+constexpr size_t kMaxSize = 1 << 16;
+
+absl::Status MakeDir(const std::string &path) {
+  while (true) {
+    const int ret = mkdir(path.c_str(), 0700);
+    if (ret != 0 && errno == EINTR) continue;
+    if (ret != 0 && errno != EEXIST)
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("mkdir failed for ", path));
+    return absl::OkStatus();
+  }
+}
+
+absl::Status WriteAll(int fd, absl::string_view buf) {
+  while (!buf.empty()) {
+    const ssize_t wret = write(fd, buf.data(), buf.size());
+    if (wret < 0 && errno == EINTR) continue;
+    if (wret < 0) return absl::ErrnoToStatus(errno, "write failed");
+    buf.remove_prefix(wret);
+  }
+  return absl::OkStatus();
+}
+}  // namespace
+
+std::string ProbeCache::DefaultPath() {
+  if (const char *const cache_home = getenv("XDG_CACHE_HOME");
+      cache_home && *cache_home)
+    return absl::StrCat(cache_home, "/ddclight/probe-cache");
+  if (const char *const home = getenv("HOME"); home && *home)
+    return absl::StrCat(home, "/.cache/ddclight/probe-cache");
+  return "";
+}
+
+// FNV-1a, since this has to be stable across runs and builds.
+uint64_t ProbeCache::HashEDID(const absl::string_view edid) {
+  uint64_t hash = 0xcbf29ce484222325;
+  for (const char c : edid) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+ProbeCache::ProbeCache(std::string path) : path_(std::move(path)) {
+  if (path_.empty()) return;
+  const auto fd = Open(path_, O_RDONLY | O_CLOEXEC);
+  if (!fd.ok()) return;
+  const auto buf = ReadStr(fd->get(), kMaxSize);
+  if (!buf.ok()) return;
+  absl::string_view contents = *buf;
+  if (!absl::ConsumePrefix(&contents, kHeader)) return;
+  absl::MutexLock l(&lock_);
+  for (const absl::string_view line :
+       absl::StrSplit(contents, '\n', absl::SkipEmpty())) {
+    const std::vector<absl::string_view> fields =
+        absl::StrSplit(line, ' ', absl::SkipEmpty());
+    if (fields.size() < 6) continue;
+    Entry entry;
+    entry.connector = std::string(fields[1]);
+    if (!absl::SimpleHexAtoi(fields[2], &entry.edid_hash)) continue;
+    entry.backend = std::string(fields[3]);
+    entry.device = std::string(fields[4]);
+    if (!absl::SimpleAtoi(fields[5], &entry.max_brightness)) continue;
+    entries_.insert_or_assign(std::string(fields[0]), std::move(entry));
+  }
+}
+
+std::optional<ProbeCache::Entry> ProbeCache::Lookup(
+    const absl::string_view output) const {
+  absl::MutexLock l(&lock_);
+  const auto it = entries_.find(output);
+  if (it == entries_.end()) return std::nullopt;
+  return it->second;
+}
+
+absl::Status ProbeCache::Update(const absl::string_view output, Entry entry) {
+  absl::MutexLock l(&lock_);
+  entries_.insert_or_assign(std::string(output), std::move(entry));
+  return Save();
+}
+
+absl::Status ProbeCache::Erase(const absl::string_view output) {
+  absl::MutexLock l(&lock_);
+  const auto it = entries_.find(output);
+  if (it == entries_.end()) return absl::OkStatus();
+  entries_.erase(it);
+  return Save();
+}
+
+// Writes to a temporary file and renames it into place, so a crash mid-write
+// leaves the previous cache intact.
+absl::Status ProbeCache::Save() const {
+  if (path_.empty()) return absl::OkStatus();
+  if (const size_t slash = path_.rfind('/'); slash != path_.npos) {
+    const std::string dir = path_.substr(0, slash);
+    if (const size_t parent = dir.rfind('/'); parent != dir.npos && parent)
+      if (auto ms = MakeDir(dir.substr(0, parent)); !ms.ok()) return ms;
+    if (auto ms = MakeDir(dir); !ms.ok()) return ms;
+  }
+  std::string contents(kHeader);
+  for (const auto &[output, entry] : entries_)
+    absl::StrAppend(&contents, output, " ", entry.connector, " ",
+                    absl::Hex(entry.edid_hash), " ", entry.backend, " ",
+                    entry.device, " ", entry.max_brightness, "\n");
+  const std::string tmp_path = absl::StrCat(path_, ".tmp");
+  auto fd = Open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+  if (!fd.ok())
+    return absl::Status(fd.status().code(),
+                        absl::StrCat("couldn't write ", tmp_path, ": ",
+                                     fd.status().message()));
+  if (auto ws = WriteAll(fd->get(), contents); !ws.ok())
+    return absl::Status(ws.code(), absl::StrCat("couldn't write ", tmp_path,
+                                                ": ", ws.message()));
+  if (auto cs = fd->Close(); !cs.ok()) return cs;
+  while (true) {
+    const int ret = rename(tmp_path.c_str(), path_.c_str());
+    if (ret != 0 && errno == EINTR) continue;
+    if (ret != 0)
+      return absl::ErrnoToStatus(errno,
+                                 absl::StrCat("rename failed for ", path_));
+    return absl::OkStatus();
+  }
+}
+}  // namespace jjaro
@@ -0,0 +1,54 @@
+#ifndef JJARO_PROBE_CACHE_H_
+#define JJARO_PROBE_CACHE_H_ 1
+#include <absl/base/thread_annotations.h>
+#include <absl/status/status.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+
+namespace jjaro {
+// Remembers which control each output ended up with across daemon restarts,
+// so startup can open it directly instead of walking sysfs, scanning DP MST
+// buses, and asking the monitor for its VCP maximum.  Entries are keyed by
+// output name and only trusted while the connector's EDID hash still matches.
+class ProbeCache {
+ public:
+  struct Entry {
+    // The `/sys/class/drm` directory name, e.g. "card0-DP-1".
+    std::string connector;
+    uint64_t edid_hash;
+    // "backlight" or "ddc-i2c".
+    std::string backend;
+    // The backlight or `i2c-*` device name.
+    std::string device;
+    // The VCP brightness maximum, or zero for backlights.
+    int max_brightness;
+  };
+
+  // `$XDG_CACHE_HOME/ddclight/probe-cache`, or empty if there's no home.
+  static std::string DefaultPath();
+  static uint64_t HashEDID(absl::string_view edid);
+
+  // Loads whatever is at `path`.  An empty `path` disables the cache.
+  explicit ProbeCache(std::string path);
+  ProbeCache(const ProbeCache &) = delete;
+  ProbeCache &operator=(const ProbeCache &) = delete;
+
+  std::optional<Entry> Lookup(absl::string_view output) const;
+  // These write the whole cache back to disk before returning.
+  absl::Status Update(absl::string_view output, Entry entry);
+  absl::Status Erase(absl::string_view output);
+
+ private:
+  absl::Status Save() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  const std::string path_;
+  mutable absl::Mutex lock_;
+  std::map<std::string, Entry, std::less<>> entries_ ABSL_GUARDED_BY(lock_);
+};
+}  // namespace jjaro
+#endif  // JJARO_PROBE_CACHE_H_
@@ -0,0 +1,135 @@
+#include "prober.h"
+
+#include <absl/functional/any_invocable.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "control.h"
+#include "edid-cache.h"
+
+namespace jjaro {
+namespace {
+// Probing is dominated by sysfs walks and DDC sleeps rather than CPU, so this
+// only needs to cover the number of monitors anyone plausibly attaches.
+constexpr size_t kMaxWorkers = 8;
+}  // namespace
+
+Prober::~Prober() {
+  std::deque<Job> jobs;
+  std::vector<std::thread> workers;
+  {
+    absl::MutexLock l(&lock_);
+    stop_ = true;
+    jobs.swap(jobs_);
+    workers.swap(workers_);
+  }
+  for (std::thread &worker : workers) worker.join();
+  // Probes can be dropped, but teardown still has to happen.
+  for (Job &job : jobs)
+    if (job.retire) std::move(job.retire)();
+}
+
+void Prober::Probe(const void *owner, std::string output, Callback done) {
+  Probe(owner, std::move(output), nullptr, std::move(done));
+}
+
+void Prober::Probe(const void *owner, std::string output, ProbeFunction probe,
+                   Callback done) {
+  absl::MutexLock l(&lock_);
+  Push(Job{owner, std::move(output), std::move(probe), std::move(done)});
+}
+
+void Prober::Retire(const void *owner, absl::AnyInvocable<void() &&> done) {
+  absl::MutexLock l(&lock_);
+  DropQueued(owner);
+  Push(Job{.owner = owner, .retire = std::move(done)});
+}
+
+void Prober::Push(Job job) {
+  jobs_.push_back(std::move(job));
+  if (idle_workers_ < jobs_.size() && workers_.size() < kMaxWorkers)
+    workers_.emplace_back(WorkerLoop, this);
+}
+
+void Prober::DropQueued(const void *owner) {
+  jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(),
+                             [owner](const Job &job) {
+                               return job.owner == owner;
+                             }),
+              jobs_.end());
+}
+
+void Prober::Drop(const void *owner) {
+  absl::MutexLock l(&lock_);
+  DropQueued(owner);
+}
+
+void Prober::Cancel(const void *owner) {
+  absl::MutexLock l(&lock_);
+  DropQueued(owner);
+  auto cond = [this, owner]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_) {
+    return !IsRunning(owner);
+  };
+  lock_.Await(absl::Condition(&cond));
+}
+
+bool Prober::IsRunning(const void *owner) const {
+  return std::find(running_.cbegin(), running_.cend(), owner) !=
+         running_.cend();
+}
+
+std::deque<Prober::Job>::iterator Prober::NextJob() {
+  return std::find_if(jobs_.begin(), jobs_.end(), [this](const Job &job) {
+    return !IsRunning(job.owner);
+  });
+}
+
+void Prober::WorkerLoop(Prober *that) {
+  while (true) {
+    Job job;
+    std::shared_ptr<EDIDCache> edid_cache;
+    {
+      absl::MutexLock l(&that->lock_);
+      auto cond = [that]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(that->lock_) {
+        return that->stop_ || that->NextJob() != that->jobs_.end();
+      };
+      ++that->idle_workers_;
+      that->lock_.Await(absl::Condition(&cond));
+      --that->idle_workers_;
+      if (that->stop_) return;
+      const auto next = that->NextJob();
+      job = std::move(*next);
+      that->jobs_.erase(next);
+      if (!job.retire) {
+        that->running_.push_back(job.owner);
+        if (!that->edid_cache_)
+          that->edid_cache_ = std::make_shared<EDIDCache>();
+        edid_cache = that->edid_cache_;
+      }
+    }
+    if (job.retire) {
+      std::move(job.retire)();
+      continue;
+    }
+    ProbeContext ctx = that->ctx_;
+    ctx.edid_cache = edid_cache.get();
+    std::move(job.done)(job.probe ? std::move(job.probe)(job.output, ctx)
+                                  : Control::Probe(job.output, ctx));
+    absl::MutexLock l(&that->lock_);
+    that->running_.erase(
+        std::find(that->running_.begin(), that->running_.end(), job.owner));
+    if (that->jobs_.empty() && that->running_.empty())
+      that->edid_cache_.reset();
+  }
+}
+}  // namespace jjaro
@@ -0,0 +1,85 @@
+#ifndef JJARO_PROBER_H_
+#define JJARO_PROBER_H_ 1
+#include <absl/base/thread_annotations.h>
+#include <absl/functional/any_invocable.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/string_view.h>
+#include <absl/synchronization/mutex.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "control.h"
+#include "edid-cache.h"
+
+namespace jjaro {
+// Runs `Control::Probe` on a pool of worker threads, so that every output is
+// probed at once and none of them are probed on the Wayland dispatch thread.
+class Prober {
+ public:
+  using Callback =
+      absl::AnyInvocable<void(absl::StatusOr<std::unique_ptr<Control>>) &&>;
+  using ProbeFunction = absl::AnyInvocable<absl::StatusOr<
+      std::unique_ptr<Control>>(absl::string_view output,
+                                const ProbeContext &ctx) &&>;
+
+  // Every probe gets `ctx`, plus an `EDIDCache` for its pass.  Whatever `ctx`
+  // points to must outlive this.
+  explicit Prober(ProbeContext ctx) : ctx_(std::move(ctx)) {}
+  Prober(const Prober &) = delete;
+  Prober &operator=(const Prober &) = delete;
+  ~Prober();
+
+  // Probes `output` on a worker thread and hands the result to `done` on that
+  // same thread.  `owner` identifies the request for `Cancel`, and one
+  // owner's probes run one at a time, in order.
+  void Probe(const void *owner, std::string output, Callback done);
+  // As above, but probing with `probe` rather than `Control::Probe`.
+  void Probe(const void *owner, std::string output, ProbeFunction probe,
+             Callback done);
+  // Drops any queued probes for `owner` and waits for a running one to finish
+  // calling its `done`.  After this returns, no worker will touch `owner`.
+  void Cancel(const void *owner);
+  // Drops any queued probes for `owner` without waiting for a running one.
+  void Drop(const void *owner);
+  // Drops any queued probes for `owner`, then runs `done` on a worker once
+  // a running one has finished, for teardown that would otherwise have to
+  // wait on it.  `owner` no longer counts as running by then, so `done` may
+  // `Cancel` it without waiting.  If the pool is destroyed first, `done`
+  // runs there instead.
+  void Retire(const void *owner, absl::AnyInvocable<void() &&> done);
+
+ private:
+  struct Job {
+    const void *owner;
+    std::string output;
+    // Null for `Control::Probe`.
+    ProbeFunction probe;
+    Callback done;
+    // Set for `Retire`, and run instead of a probe.
+    absl::AnyInvocable<void() &&> retire;
+  };
+  static void WorkerLoop(Prober *that);
+  bool IsRunning(const void *owner) const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void Push(Job job) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  void DropQueued(const void *owner) ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+  // The first queued job whose owner has nothing running, or `jobs_.end()`.
+  std::deque<Job>::iterator NextJob() ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+  const ProbeContext ctx_;
+  absl::Mutex lock_;
+  std::deque<Job> jobs_ ABSL_GUARDED_BY(lock_);
+  std::vector<const void *> running_ ABSL_GUARDED_BY(lock_);
+  // Shared by every probe from the moment the pool gets work until it next
+  // runs dry, which is as close as we get to one enumeration pass.
+  std::shared_ptr<EDIDCache> edid_cache_ ABSL_GUARDED_BY(lock_);
+  size_t idle_workers_ ABSL_GUARDED_BY(lock_) = 0;
+  bool stop_ ABSL_GUARDED_BY(lock_) = false;
+  std::vector<std::thread> workers_ ABSL_GUARDED_BY(lock_);
+};
+}  // namespace jjaro
+#endif  // JJARO_PROBER_H_
@@ -0,0 +1,111 @@
+#include "reactor.h"
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <utility>
+
+#include "fd-holder.h"
+
+namespace jjaro {
+absl::StatusOr<Reactor> Reactor::Create() {
+  FDHolder epoll_fd(epoll_create1(EPOLL_CLOEXEC));
+  if (epoll_fd.get() == -1)
+    return absl::ErrnoToStatus(errno, "failed to create epoll");
+  FDHolder wake_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+  if (wake_fd.get() == -1)
+    return absl::ErrnoToStatus(errno, "failed to create eventfd");
+  const int wake = wake_fd.get();
+  Reactor reactor(std::move(epoll_fd), std::move(wake_fd));
+  if (auto ws = reactor.Watch(wake, EPOLLIN,
+                              [wake](uint32_t) {
+                                uint64_t count;
+                                while (read(wake, &count, sizeof(count)) < 0 &&
+                                       errno == EINTR) {
+                                }
+                              });
+      !ws.ok())
+    return ws;
+  return reactor;
+}
+
+absl::Status Reactor::Watch(int fd, uint32_t events, Ready ready) {
+  auto it = watched_.find(fd);
+  if (it != watched_.end() && it->second->events == events) {
+    if (ready) it->second->ready = std::move(ready);
+    return absl::OkStatus();
+  }
+  struct epoll_event ev = {.events = events, .data = {.fd = fd}};
+  const bool add = it == watched_.end();
+  if (add && !ready)
+    return absl::InvalidArgumentError("new fds need a callback");
+  if (epoll_ctl(epoll_fd_.get(), add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd,
+                &ev) == -1)
+    return absl::ErrnoToStatus(errno, "failed to watch fd");
+  if (add) {
+    watched_.emplace(fd, std::make_shared<Watched>(
+                             Watched{.events = events, .ready = std::move(ready)}));
+  } else {
+    it->second->events = events;
+    if (ready) it->second->ready = std::move(ready);
+  }
+  return absl::OkStatus();
+}
+
+absl::Status Reactor::Unwatch(int fd) {
+  if (!watched_.erase(fd)) return absl::OkStatus();
+  if (epoll_ctl(epoll_fd_.get(), EPOLL_CTL_DEL, fd, nullptr) == -1)
+    return absl::ErrnoToStatus(errno, "failed to unwatch fd");
+  return absl::OkStatus();
+}
+
+int Reactor::AddPrepare(Prepare prepare) {
+  prepares_.emplace(next_prepare_, std::move(prepare));
+  return next_prepare_++;
+}
+void Reactor::RemovePrepare(int id) { prepares_.erase(id); }
+
+void Reactor::Wake() {
+  const uint64_t one = 1;
+  while (write(wake_fd_.get(), &one, sizeof(one)) < 0 && errno == EINTR) {
+  }
+}
+
+absl::Status Reactor::Run() {
+  struct epoll_event events[16];
+  while (true) {
+    absl::Time deadline = absl::InfiniteFuture();
+    for (auto &[id, prepare] : prepares_)
+      deadline = std::min(deadline, prepare());
+    // Rounded up, so as not to wake just short of the deadline and spin.
+    const int timeout_ms =
+        deadline == absl::InfiniteFuture()
+            ? -1
+            : std::max<int64_t>(
+                  0, absl::ToInt64Milliseconds(deadline - absl::Now() +
+                                               absl::Milliseconds(1) -
+                                               absl::Nanoseconds(1)));
+    const int n = epoll_wait(epoll_fd_.get(), events, std::size(events),
+                             timeout_ms);
+    if (n == -1 && errno == EINTR) continue;
+    if (n == -1) return absl::ErrnoToStatus(errno, "failed to wait for events");
+    for (int i = 0; i < n; ++i) {
+      const auto it = watched_.find(events[i].data.fd);
+      // An earlier callback this round may have unwatched it.
+      if (it == watched_.end()) continue;
+      const std::shared_ptr<Watched> watched = it->second;
+      watched->ready(events[i].events);
+    }
+  }
+}
+}  // namespace jjaro
@@ -0,0 +1,63 @@
+#ifndef JJARO_REACTOR_H_
+#define JJARO_REACTOR_H_ 1
+#include <absl/functional/any_invocable.h>
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/time/time.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "fd-holder.h"
+
+namespace jjaro {
+// One epoll loop for the Wayland display, the D-Bus connection, the socket
+// and hotplug events, so that they're served from the same thread.  Outputs
+// don't run on it yet: each still has a thread of its own, plus a watch
+// thread for backlights, since i2c-dev transfers block.  Driving their set,
+// verify and read-back loops from here on timerfds is left to be done.
+class Reactor {
+ public:
+  // Called with the epoll events `fd` is ready for.
+  using Ready = absl::AnyInvocable<void(uint32_t events)>;
+  // Called before every wait, to bring fds up to date and to dispatch
+  // anything already buffered.  Returns when it next needs to run, or
+  // `absl::InfiniteFuture()`.
+  using Prepare = absl::AnyInvocable<absl::Time()>;
+
+  static absl::StatusOr<Reactor> Create();
+  Reactor(Reactor &&) = default;
+  Reactor &operator=(Reactor &&) = default;
+
+  // Starts watching `fd`, or changes what for.  `ready` may be null when only
+  // `events` is changing.
+  absl::Status Watch(int fd, uint32_t events, Ready ready = nullptr);
+  absl::Status Unwatch(int fd);
+  int AddPrepare(Prepare prepare);
+  void RemovePrepare(int id);
+  // Has `Run` go around again, and so run every prepare, from any thread.
+  void Wake();
+  // Waits for and dispatches events until an error.
+  absl::Status Run();
+
+ private:
+  struct Watched {
+    uint32_t events;
+    Ready ready;
+  };
+
+  Reactor(FDHolder epoll_fd, FDHolder wake_fd)
+      : epoll_fd_(std::move(epoll_fd)), wake_fd_(std::move(wake_fd)) {}
+
+  FDHolder epoll_fd_;
+  // An eventfd that `Wake` writes to.
+  FDHolder wake_fd_;
+  // Held by `shared_ptr` so that a callback can unwatch its own fd.
+  std::map<int, std::shared_ptr<Watched>> watched_;
+  std::map<int, Prepare> prepares_;
+  int next_prepare_ = 0;
+};
+}  // namespace jjaro
+#endif  // JJARO_REACTOR_H_
@@ -0,0 +1,256 @@
+// How many read-backs a `ReconcileSchedule` makes over a simulated hour with
+// a brightness change every `change_interval_s`, against reading back every
+// second regardless.  With `drifted`, the first read finds the output changed
+// from elsewhere, so it never stops reading altogether.
+#include <absl/status/status.h>
+#include <absl/strings/str_cat.h>
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <memory>
+
+#include "brightness.h"
+#include "control-ddc-i2c.h"
+#include "control.h"
+#include "ddc-ci.h"
+#include "ddc-emulator.h"
+#include "ddc-pacer.h"
+#include "edid-cache.h"
+#include "misc.h"
+#include "reconcile-schedule.h"
+#include "sysfs-fixture.h"
+
+namespace jjaro {
+namespace {
+constexpr auto kMinInterval = absl::Seconds(1);
+constexpr auto kMaxInterval = absl::Minutes(5);
+
+void BM_ReconcileSchedule(benchmark::State &state) {
+  const absl::Duration change_interval = absl::Seconds(state.range(0));
+  const bool drifted = state.range(1);
+  constexpr absl::Duration kHour = absl::Hours(1);
+  int64_t reads = 0;
+  for (auto _ : state) {
+    ReconcileSchedule schedule(kMinInterval, kMaxInterval);
+    int64_t reads_this_hour = 0;
+    const absl::Time start = absl::UnixEpoch();
+    absl::Time next_change = start;
+    while (next_change < start + kHour || schedule.next() < start + kHour) {
+      if (next_change <= schedule.next()) {
+        schedule.Activity(next_change);
+        next_change += change_interval;
+      } else {
+        schedule.Polled(schedule.next(), drifted && reads_this_hour == 0);
+        ++reads_this_hour;
+      }
+      if (next_change >= start + kHour) next_change = absl::InfiniteFuture();
+    }
+    reads += reads_this_hour;
+  }
+  state.counters["reads_per_hour"] =
+      benchmark::Counter(reads, benchmark::Counter::kAvgIterations);
+  state.counters["fixed_reads_per_hour"] = kHour / kMinInterval;
+}
+BENCHMARK(BM_ReconcileSchedule)
+    ->ArgNames({"change_interval_s", "drifted"})
+    ->ArgsProduct({{10, 60, 600, 3600}, {0, 1}});
+
+// One change to a monitor whose VCP maximum is `max`, then an hour of reading
+// it back through a real control with nobody else touching it.  An output
+// wakes to set its target again whenever the level the control reports isn't
+// the target, which counts as activity and starts the backoff over, so a
+// level that doesn't survive a read-back would keep it reading at the
+// fastest rate all hour.
+void BM_ReconcileIdleDDC(benchmark::State &state) {
+  const int max = state.range(0);
+  constexpr int kTarget = kMaxBrightnessLevel / 2;
+  constexpr absl::Duration kHour = absl::Hours(1);
+  EmulatedDDCMonitor monitor("", {.reply_latency = absl::ZeroDuration()});
+  monitor.SetFeature(static_cast<uint8_t>(ddc::kVCPBrightness), 0, max);
+  auto control = I2CDDCControl::Create(
+      "i2c-3", monitor.Connect(), /*verify_every=*/0,
+      std::make_shared<DDCPacer>(absl::ZeroDuration()));
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int64_t reads = 0, resets = 0;
+  absl::Duration last_interval;
+  for (auto _ : state) {
+    if (!control->SetBrightnessLevel(kTarget).ok()) {
+      state.SkipWithError("set failed");
+      return;
+    }
+    ReconcileSchedule schedule(kMinInterval, kMaxInterval);
+    const absl::Time start = absl::UnixEpoch();
+    schedule.Activity(start);
+    absl::Time last_read = start;
+    while (schedule.next() < start + kHour) {
+      const absl::Time now = schedule.next();
+      last_interval = now - last_read;
+      last_read = now;
+      if (!control->GetBrightnessLevel().ok()) {
+        state.SkipWithError("read failed");
+        return;
+      }
+      ++reads;
+      schedule.Polled(now, false);
+      if (control->cached_brightness_level().value_or(-1) != kTarget) {
+        schedule.Activity(now);
+        ++resets;
+      }
+    }
+    // Start the next iteration from somewhere else.
+    control->SetBrightnessLevel(0).IgnoreError();
+  }
+  state.counters["reads_per_hour"] =
+      benchmark::Counter(reads, benchmark::Counter::kAvgIterations);
+  state.counters["resets_per_hour"] =
+      benchmark::Counter(resets, benchmark::Counter::kAvgIterations);
+  state.counters["last_interval_s"] = absl::ToDoubleSeconds(last_interval);
+}
+BENCHMARK(BM_ReconcileIdleDDC)->ArgNames({"max"})->Arg(100)->Arg(255);
+
+// Sets a monitor that rounds brightness down to a multiple of `step`, reads
+// it back as `Output::Reconcile` does, then changes it from elsewhere and
+// reads it again.  The monitor's rounding of its own writes shouldn't fail
+// verification or count as moved, and the changes from elsewhere should, or
+// the run fails.
+void BM_ReconcileRoundingDDC(benchmark::State &state) {
+  const int step = state.range(0);
+  EmulatedDDCMonitor monitor(
+      "", {.reply_latency = absl::ZeroDuration(),
+           .brightness_step = static_cast<uint16_t>(step)});
+  auto control = I2CDDCControl::Create(
+      "i2c-3", monitor.Connect(), /*verify_every=*/1,
+      std::make_shared<DDCPacer>(absl::ZeroDuration()));
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  int64_t failures = 0, own_moves = 0, missed = 0;
+  int percent = 0;
+  for (auto _ : state) {
+    percent = (percent + 3) % 101;
+    if (!control->SetBrightnessLevel(LevelFromPercent(percent)).ok()) {
+      ++failures;
+      continue;
+    }
+    auto moved = control->ReadBackMoved();
+    if (!moved.ok()) {
+      state.SkipWithError(moved.status().ToString().c_str());
+      return;
+    }
+    own_moves += *moved;
+    // Off the monitor's own steps, so the next set can't look dropped.
+    monitor.SetFeature(static_cast<uint8_t>(ddc::kVCPBrightness),
+                       (percent + 50) % 90 / step * step + 1, 100);
+    moved = control->ReadBackMoved();
+    if (!moved.ok()) {
+      state.SkipWithError(moved.status().ToString().c_str());
+      return;
+    }
+    missed += !*moved;
+  }
+  state.counters["failures"] = failures;
+  state.counters["own_moves"] = own_moves;
+  state.counters["missed"] = missed;
+  if (failures || own_moves || missed)
+    state.SkipWithError(absl::StrCat(failures, " failed sets, ", own_moves,
+                                     " own writes taken as moved, ", missed,
+                                     " outside changes missed")
+                            .c_str());
+}
+BENCHMARK(BM_ReconcileRoundingDDC)->ArgNames({"step"})->Arg(1)->Arg(7);
+
+// Replaces what a synthetic sysfs attribute reads as, as its driver would.
+absl::Status WriteAttr(int fd, int value) {
+  const absl::AlphaNum val(value);
+  while (true) {
+    const ssize_t wret = pwrite(fd, val.data(), val.size(), 0);
+    if (wret < 0 && errno == EINTR) continue;
+    if (wret < 0) return absl::ErrnoToStatus(errno, "pwrite failed");
+    break;
+  }
+  if (ftruncate(fd, val.size()) < 0)
+    return absl::ErrnoToStatus(errno, "ftruncate failed");
+  return absl::OkStatus();
+}
+
+// `BM_ReconcileRoundingDDC` for a backlight whose driver keeps
+// `actual_brightness` in steps of `step` out of the fixture's 1000, so it
+// never reads as what was written to `brightness` unless they happen to
+// line up.
+void BM_ReconcileQuantisedBacklight(benchmark::State &state) {
+  constexpr int kMaxRaw = 1000;
+  // Above every level set here and off every step, so it's never a value
+  // the control wrote or a rounding of one.
+  constexpr int kOutsideRaw = 999;
+  const int step = state.range(0);
+  auto sysfs = SyntheticSysfs::Create({.backlights = 1});
+  if (!sysfs.ok()) {
+    state.SkipWithError(sysfs.status().ToString().c_str());
+    return;
+  }
+  EDIDCache edid_cache;
+  auto control = Control::Probe(
+      sysfs->outputs()[0], {.root = sysfs->root(), .edid_cache = &edid_cache});
+  if (!control.ok()) {
+    state.SkipWithError(control.status().ToString().c_str());
+    return;
+  }
+  auto actual_fd = Open(absl::StrCat(sysfs->root(), "/sys/class/backlight/",
+                                     (*control)->name(), "/actual_brightness"),
+                        O_WRONLY | O_CLOEXEC);
+  if (!actual_fd.ok()) {
+    state.SkipWithError(actual_fd.status().ToString().c_str());
+    return;
+  }
+  int64_t own_moves = 0, missed = 0;
+  int percent = 0;
+  for (auto _ : state) {
+    percent = (percent + 3) % 90;
+    const int level = LevelFromPercent(percent);
+    // A regular file can't see the write, so the driver's rounding of it is
+    // put in place beforehand.
+    auto ws = WriteAttr(actual_fd->get(),
+                        RawFromLevel(level, kMaxRaw) / step * step);
+    if (ws.ok()) ws = (*control)->SetBrightnessLevel(level);
+    if (!ws.ok()) {
+      state.SkipWithError(ws.ToString().c_str());
+      return;
+    }
+    auto moved = (*control)->ReadBackMoved();
+    if (!moved.ok()) {
+      state.SkipWithError(moved.status().ToString().c_str());
+      return;
+    }
+    own_moves += *moved;
+    if (ws = WriteAttr(actual_fd->get(), kOutsideRaw); !ws.ok()) {
+      state.SkipWithError(ws.ToString().c_str());
+      return;
+    }
+    moved = (*control)->ReadBackMoved();
+    if (!moved.ok()) {
+      state.SkipWithError(moved.status().ToString().c_str());
+      return;
+    }
+    missed += !*moved;
+  }
+  state.counters["own_moves"] = own_moves;
+  state.counters["missed"] = missed;
+  if (own_moves || missed)
+    state.SkipWithError(absl::StrCat(own_moves, " own writes taken as moved, ",
+                                     missed, " outside changes missed")
+                            .c_str());
+}
+BENCHMARK(BM_ReconcileQuantisedBacklight)
+    ->ArgNames({"step"})
+    ->Arg(1)
+    ->Arg(64);
+}  // namespace
+}  // namespace jjaro
@@ -0,0 +1,28 @@
+#include "reconcile-schedule.h"
+
+#include <absl/time/time.h>
+
+#include <algorithm>
+
+namespace jjaro {
+void ReconcileSchedule::Activity(absl::Time now) {
+  if (min_ <= absl::ZeroDuration()) return;
+  interval_ = min_;
+  next_ = now + interval_;
+}
+
+void ReconcileSchedule::Polled(absl::Time now, bool drifted) {
+  if (min_ <= absl::ZeroDuration()) return;
+  if (drifted) {
+    // Someone's at the buttons, so they may well not be done.
+    ever_drifted_ = true;
+    interval_ = min_;
+  } else if (interval_ < max_) {
+    interval_ = std::min(interval_ * 2, max_);
+  } else if (!ever_drifted_) {
+    next_ = absl::InfiniteFuture();
+    return;
+  }
+  next_ = now + interval_;
+}
+}  // namespace jjaro
@@ -0,0 +1,32 @@
+#ifndef JJARO_RECONCILE_SCHEDULE_H_
+#define JJARO_RECONCILE_SCHEDULE_H_ 1
+#include <absl/time/time.h>
+
+namespace jjaro {
+// When an output should next read its brightness back, to notice it being
+// changed from the monitor's own buttons or by another tool.  Reads start
+// every `min_interval` after this daemon changes the output, and back off
+// exponentially to `max_interval` while nothing else does.  An output that
+// hasn't drifted yet stops being read once the backoff runs out, until the
+// next change; one that has keeps being read every `max_interval`.
+//
+// A zero `min_interval` never reads at all.
+class ReconcileSchedule {
+ public:
+  ReconcileSchedule(absl::Duration min_interval, absl::Duration max_interval)
+      : min_(min_interval), max_(max_interval), interval_(min_interval) {}
+
+  // After this daemon changed the output at `now`.
+  void Activity(absl::Time now);
+  // After a read at `now`, which found the output where it was left, or not.
+  void Polled(absl::Time now, bool drifted);
+  // `absl::InfiniteFuture()` if there's nothing to read until `Activity`.
+  absl::Time next() const { return next_; }
+
+ private:
+  absl::Duration min_, max_, interval_;
+  absl::Time next_ = absl::InfiniteFuture();
+  bool ever_drifted_ = false;
+};
+}  // namespace jjaro
+#endif  // JJARO_RECONCILE_SCHEDULE_H_
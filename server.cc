@@ -1,78 +1,495 @@
 #include "server.h"
 
 #include <absl/functional/any_invocable.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/string_view.h>
 #include <absl/synchronization/mutex.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <sys/epoll.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
+#include <cstdlib>
+#include <list>
+#include <map>
+#include <memory>
 #include <optional>
+#include <string>
 #include <utility>
 
-#include "output.h"
+#include "brightness.h"
+#include "control.h"
+#include "ddc-ci.h"
+#include "hotplug.h"
+#include "line-socket.h"
+#include "output-object.h"
+#include "probe-cache.h"
+#include "reactor.h"
 #include "state.h"
+#include "trace.h"
+#include "watch-notifier.h"
 
 namespace jjaro {
+namespace {
+// Lets the daemon run against a synthetic sysfs and devfs tree.
+std::string SysfsRoot() {
+  const char *const root = getenv("DDCLIGHT_SYSFS_ROOT");
+  return root ? root : "";
+}
+
+bool IsVCPFeature(const int64_t code) {
+  return code >= 0 && code <= UINT8_MAX &&
+         code != static_cast<int64_t>(ddc::kVCPBrightness);
+}
 
-DDCLight::DDCLight(sdbus::IConnection& connection, sdbus::ObjectPath objectPath)
+// How many DDC/CI writes to make between read-backs; unset or zero means only
+// read back once the bus goes idle.
+int DDCVerifyEvery() {
+  const char *const every = getenv("DDCLIGHT_DDC_VERIFY_EVERY");
+  int ret;
+  if (!every || !absl::SimpleAtoi(every, &ret) || ret < 0) return 0;
+  return ret;
+}
+
+// How soon outputs read their brightness back after a change, to notice it
+// being changed from elsewhere; unset or zero means they don't.
+absl::Duration ReconcileInterval() {
+  const char *const ms = getenv("DDCLIGHT_RECONCILE_MS");
+  int ret;
+  if (!ms || !absl::SimpleAtoi(ms, &ret) || ret < 0)
+    return absl::ZeroDuration();
+  return absl::Milliseconds(ret);
+}
+
+// How often to send `watch` at most while the percentage keeps changing;
+// unset means about once a frame.
+absl::Duration WatchInterval() {
+  const char *const ms = getenv("DDCLIGHT_WATCH_INTERVAL_MS");
+  int ret;
+  if (!ms || !absl::SimpleAtoi(ms, &ret) || ret < 0)
+    return absl::Milliseconds(16);
+  return absl::Milliseconds(ret);
+}
+}  // namespace
+
+DDCLight::DDCLight(sdbus::IConnection& connection, sdbus::ObjectPath objectPath,
+                   Reactor* reactor)
     : AdaptorInterfaces(connection, std::move(objectPath)),
+      connection_(connection),
+      reactor_(reactor),
+      reconcile_interval_(ReconcileInterval()),
+      probe_cache_(ProbeCache::DefaultPath()),
       enumerator_(
+          reactor,
           [this](uint32_t name, uint32_t version) { AddOutput(name, version); },
-          [this](uint32_t name) { RemoveOutput(name); }) {
+          [this](uint32_t name) { RemoveOutput(name); }),
+      watch_(WatchInterval(), [this](int64_t percentage) {
+        emitWatch(percentage);
+        if (socket_) socket_->Broadcast(absl::StrCat(percentage));
+      }),
+      prober_({.root = SysfsRoot(),
+               .probe_cache = &probe_cache_,
+               .ddc_verify_every = DDCVerifyEvery(),
+               .ddc_pacers = &ddc_pacers_}) {
   registerAdaptor();
+  bus_prepare_ = reactor_->AddPrepare([this] { return PrepareBus(); });
+  if (const std::string path = SocketPath(); !path.empty()) {
+    auto socket = LineSocketServer::Listen(
+        reactor_, path,
+        [this](absl::string_view request) { return HandleRequest(request); });
+    if (socket.ok()) {
+      socket_ = *std::move(socket);
+    } else {
+      absl::FPrintF(stderr, "Not listening on %s: %s\n", path,
+                    socket.status().ToString());
+    }
+  }
+  auto hotplug = HotplugMonitor::Create(
+      reactor_, [this](const Uevent& event) { HandleUevent(event); });
+  if (hotplug.ok()) {
+    hotplug_ = *std::move(hotplug);
+  } else {
+    absl::FPrintF(stderr, "Not watching for hotplug: %s\n",
+                  hotplug.status().ToString());
+  }
+}
+// Outputs still here go before the Wayland display they were bound from.
+// Waiting on their probes and threads is fine by now.
+DDCLight::~DDCLight() {
+  outputs_.clear();
+  hotplug_.reset();
+  reactor_->RemovePrepare(bus_prepare_);
+  if (bus_fd_ != -1) reactor_->Unwatch(bus_fd_).IgnoreError();
+  if (bus_event_fd_ != -1) reactor_->Unwatch(bus_event_fd_).IgnoreError();
+  unregisterAdaptor();
+}
+
+// Handles everything the connection has ready, sends any `watch` that's due
+// for changes made since, then points the reactor at whatever it'll need
+// next.  The fds themselves need no callback, since waking is enough to get
+// back here.
+absl::Time DDCLight::PrepareBus() {
+  while (connection_.processPendingEvent()) {
+  }
+  PassOnDrifts();
+  const absl::Time set_wait_due = AnswerSetWaits();
+  const absl::Time watch_due = watch_.Flush();
+  const auto poll = connection_.getEventLoopPollData();
+  // poll(2) and epoll flags have the same values.
+  const auto ws = reactor_->Watch(poll.fd, static_cast<uint16_t>(poll.events),
+                                  [](uint32_t) {});
+  const auto es = reactor_->Watch(poll.eventFd, EPOLLIN, [](uint32_t) {});
+#ifndef NDEBUG
+  if (!ws.ok() || !es.ok())
+    absl::FPrintF(stderr, "Failed to watch D-Bus connection: %s %s\n",
+                  ws.ToString(), es.ToString());
+#endif
+  bus_fd_ = poll.fd;
+  bus_event_fd_ = poll.eventFd;
+  const int timeout_ms = poll.getPollTimeout();
+  return std::min({set_wait_due, watch_due,
+                   timeout_ms < 0
+                       ? absl::InfiniteFuture()
+                       : absl::Now() + absl::Milliseconds(timeout_ms)});
 }
-DDCLight::~DDCLight() { unregisterAdaptor(); }
 
 void DDCLight::AddOutput(uint32_t name, uint32_t version) {
-  outputs_.emplace_back(&state_, &enumerator_, name, version);
+  outputs_.emplace_back(
+      connection_,
+      sdbus::ObjectPath(absl::StrCat(getObjectPath(), "/outputs/", name)),
+      &state_, &prober_, &lockstep_, &enumerator_, name, version,
+      reconcile_interval_,
+      [this] {
+        if (set_waiting_.load(std::memory_order_relaxed)) reactor_->Wake();
+      },
+      [this](absl::string_view output, int level) {
+        {
+          absl::MutexLock l(&drift_lock_);
+          drifts_.insert_or_assign(std::string(output), level);
+        }
+        reactor_->Wake();
+      });
 }
+// Destroying an output waits on any probe of it and on its thread, either of
+// which may be partway through a transaction with a slow monitor, so only
+// the D-Bus and Wayland side goes here, and a `Prober` worker does the rest.
 void DDCLight::RemoveOutput(uint32_t name) {
-  for (auto it = outputs_.cbegin(); it != outputs_.cend(); ++it) {
+  for (auto it = outputs_.begin(); it != outputs_.end(); ++it) {
     if (it->wayland_name() != name) continue;
-    outputs_.erase(it);
+    it->Unregister();
+    auto retired = std::make_unique<std::list<OutputObject>>();
+    retired->splice(retired->end(), outputs_, it);
+    const Output* const output = &retired->front().output();
+    prober_.Retire(output, [retired = std::move(retired)]() mutable {
+      retired.reset();
+    });
     return;
   }
 }
 
-int64_t DDCLight::get() {
+// Probes only the outputs an event could change.  Outputs that already have a
+// control keep it unless its own device goes away; a connector that changes
+// is announced again by the compositor, which probes it then.
+void DDCLight::HandleUevent(const Uevent& event) {
+  ++hotplug_events_;
+#ifndef NDEBUG
+  absl::FPrintF(stderr, "Hotplug: %s %s %s\n", event.action, event.subsystem,
+                event.devpath);
+#endif
+  const absl::string_view connector = event.Connector();
+  const absl::string_view device = event.Device();
+  const bool is_bus = event.subsystem == "i2c-dev";
+  for (auto& object : outputs_) {
+    Output& output = object.output();
+    const Output::Info info = output.info();
+    if (event.action == "remove") {
+      if (info.backend.empty() || info.device != device) continue;
+      ++reprobes_;
+      output.Reprobe();
+      continue;
+    }
+    if (event.action != "add" && (is_bus || event.action != "change"))
+      continue;
+    // Backlights don't change but for their brightness.
+    if (event.subsystem == "backlight" && event.action != "add") continue;
+    // Outputs without a name are still on their first probe.
+    if (!info.backend.empty() || info.name.empty()) continue;
+    if (!connector.empty() && info.name != connector) continue;
+    if (is_bus) {
+      ++device_probes_;
+      output.ProbeDevice(std::string(device));
+    } else {
+      ++reprobes_;
+      output.Reprobe();
+    }
+  }
+}
+
+// Tells watchers where outputs that were changed from elsewhere have ended up.
+// With only one output, its own target is simply the target, so that `get`
+// and `increment` go from there too.
+void DDCLight::PassOnDrifts() {
+  std::map<std::string, int> drifts;
+  {
+    absl::MutexLock l(&drift_lock_);
+    drifts.swap(drifts_);
+  }
+  if (drifts.empty()) return;
+  int controlled = 0;
+  for (const auto& output : outputs_)
+    if (!output.output().info().backend.empty()) ++controlled;
+  for (const auto& [output, level] : drifts) {
+    {
+      StateUpdate u(&state_);
+      if (const auto it = state_.output_levels.find(output);
+          controlled == 1 && state_.output_levels.size() == 1 &&
+          it != state_.output_levels.end() && it->second == level) {
+        state_.desired_level = level;
+        state_.output_levels.clear();
+        u.Changed();
+      }
+    }
+    NotifyWatchers(level);
+  }
+}
+
+void DDCLight::NotifyWatchers(int level) {
+  watch_.Changed(PercentFromLevel(level));
+}
+
+// Requests over `socket_` map straight onto the D-Bus methods.
+std::string DDCLight::HandleRequest(absl::string_view request) {
+  const std::pair<absl::string_view, absl::string_view> parts =
+      absl::StrSplit(request, absl::MaxSplits(' ', 1));
+  const auto [command, arg] = parts;
+  if (command == "get" && arg.empty()) return absl::StrCat(get());
+  if (command == "getlevel" && arg.empty()) return absl::StrCat(getlevel());
+  int64_t value;
+  if (!absl::SimpleAtoi(arg, &value))
+    return absl::StrCat("error bad request: ", request);
+  if (command == "set") return absl::StrCat(set(value));
+  if (command == "setlevel") return absl::StrCat(setlevel(value));
+  if (command == "increment") return absl::StrCat(increment(value));
+  if (command == "decrement") return absl::StrCat(decrement(value));
+  return absl::StrCat("error unknown command: ", command);
+}
+
+int64_t DDCLight::get() { return PercentFromLevel(getlevel()); }
+int64_t DDCLight::getlevel() {
   absl::MutexLock l(&state_.lock);
-  return state_.desired_percentage.value_or(50);
+  return state_.desired_level.value_or(kMaxBrightnessLevel / 2);
 }
 int64_t DDCLight::poke() {
-  emitWatch(state_.desired_percentage.value_or(50));
-  return state_.desired_percentage.value_or(50);
+  NotifyWatchers(state_.desired_level.value_or(kMaxBrightnessLevel / 2));
+  return get();
 }
+// The percentage methods are the level ones in steps of a percent, and answer
+// to the nearest percent.
 int64_t DDCLight::set(const int64_t& percentage) {
-  const int real_percentage = std::clamp(percentage, int64_t{0}, int64_t{100});
-  absl::MutexLock l(&state_.lock);
-  if (state_.desired_percentage.has_value() &&
-      *state_.desired_percentage == real_percentage)
-    return *state_.desired_percentage;
-  state_.desired_percentage = real_percentage;
-  emitWatch(*state_.desired_percentage);
-  return *state_.desired_percentage;
+  return PercentFromLevel(
+      setlevel(LevelFromPercent(std::clamp(percentage, int64_t{0},
+                                           int64_t{100}))));
+}
+int64_t DDCLight::setlevel(const int64_t& level) {
+  const int real_level =
+      std::clamp(level, int64_t{0}, int64_t{kMaxBrightnessLevel});
+  TraceScope trace("DDCLight::set");
+  trace.Arg("level", real_level);
+  StateUpdate u(&state_);
+  // Setting the target of a fade in progress still means going there now.
+  if (state_.transition.has_value() &&
+      state_.transition->end > absl::Now()) {
+    state_.transition.reset();
+  } else if (state_.desired_level.has_value() &&
+             *state_.desired_level == real_level &&
+             state_.output_levels.empty()) {
+    return *state_.desired_level;
+  }
+  state_.desired_level = real_level;
+  state_.output_levels.clear();
+  u.TargetChanged();
+  NotifyWatchers(*state_.desired_level);
+  return *state_.desired_level;
 }
 int64_t DDCLight::increment(const int64_t& percentage) {
   const int real_percentage = std::clamp(percentage, int64_t{0}, int64_t{100});
-  absl::MutexLock l(&state_.lock);
-  if (real_percentage == 0) return state_.desired_percentage.value_or(50);
-  if (state_.desired_percentage.has_value() &&
-      *state_.desired_percentage == 100)
-    return *state_.desired_percentage;
-  state_.desired_percentage = std::min(
-      int64_t{100}, state_.desired_percentage.value_or(50) + percentage);
-  emitWatch(*state_.desired_percentage);
-  return *state_.desired_percentage;
+  TraceScope trace("DDCLight::increment");
+  trace.Arg("percentage", real_percentage);
+  StateUpdate u(&state_);
+  const int step = LevelFromPercent(real_percentage);
+  const int desired = state_.desired_level.value_or(kMaxBrightnessLevel / 2);
+  if (step == 0 || (desired == kMaxBrightnessLevel &&
+                    state_.output_levels.empty()))
+    return PercentFromLevel(desired);
+  state_.transition.reset();
+  state_.desired_level = std::min(kMaxBrightnessLevel, desired + step);
+  // Outputs with targets of their own keep their places relative to the rest.
+  for (auto& [output, output_level] : state_.output_levels)
+    output_level = std::min(kMaxBrightnessLevel, output_level + step);
+  u.TargetChanged();
+  NotifyWatchers(*state_.desired_level);
+  return PercentFromLevel(*state_.desired_level);
 }
 int64_t DDCLight::decrement(const int64_t& percentage) {
   const int real_percentage = std::clamp(percentage, int64_t{0}, int64_t{100});
+  TraceScope trace("DDCLight::decrement");
+  trace.Arg("percentage", real_percentage);
+  StateUpdate u(&state_);
+  const int step = LevelFromPercent(real_percentage);
+  const int desired = state_.desired_level.value_or(kMaxBrightnessLevel / 2);
+  if (step == 0 || (desired == 0 && state_.output_levels.empty()))
+    return PercentFromLevel(desired);
+  state_.transition.reset();
+  state_.desired_level = std::max(0, desired - step);
+  for (auto& [output, output_level] : state_.output_levels)
+    output_level = std::max(0, output_level - step);
+  u.TargetChanged();
+  NotifyWatchers(*state_.desired_level);
+  return PercentFromLevel(*state_.desired_level);
+}
+int64_t DDCLight::fade(const int64_t& percentage, const int64_t& duration_ms) {
+  return PercentFromLevel(fadelevel(
+      LevelFromPercent(std::clamp(percentage, int64_t{0}, int64_t{100})),
+      duration_ms));
+}
+int64_t DDCLight::fadelevel(const int64_t& level, const int64_t& duration_ms) {
+  if (duration_ms <= 0) return setlevel(level);
+  const int real_level =
+      std::clamp(level, int64_t{0}, int64_t{kMaxBrightnessLevel});
+  TraceScope trace("DDCLight::fade");
+  trace.Arg("level", real_level);
+  trace.Arg("duration_ms", duration_ms);
+  StateUpdate u(&state_);
+  // Start from wherever a fade already in progress has got to.
+  const absl::Time now = absl::Now();
+  state_.transition = Transition{.from = state_.TargetAt(now),
+                                 .to = real_level,
+                                 .start = now,
+                                 .end = now + absl::Milliseconds(duration_ms)};
+  state_.desired_level = real_level;
+  state_.output_levels.clear();
+  u.TargetChanged();
+  NotifyWatchers(*state_.desired_level);
+  return *state_.desired_level;
+}
+// These return -1 for codes that aren't VCP features, and for brightness,
+// which has its own methods.  Feature values are only as the daemon last set
+// them, or -1 if it hasn't.
+int64_t DDCLight::getvcp(const int64_t& code) {
+  if (!IsVCPFeature(code)) return -1;
   absl::MutexLock l(&state_.lock);
-  if (real_percentage == 0) return state_.desired_percentage.value_or(50);
-  if (state_.desired_percentage.has_value() && *state_.desired_percentage == 0)
-    return *state_.desired_percentage;
-  state_.desired_percentage =
-      std::max(int64_t{0}, state_.desired_percentage.value_or(50) - percentage);
-  emitWatch(*state_.desired_percentage);
-  return *state_.desired_percentage;
+  const auto it = state_.vcp_features.find(code);
+  return it == state_.vcp_features.end() ? -1 : it->second;
+}
+int64_t DDCLight::setvcp(const int64_t& code, const int64_t& value) {
+  if (!IsVCPFeature(code)) return -1;
+  const uint16_t real_value =
+      std::clamp(value, int64_t{0}, int64_t{UINT16_MAX});
+  StateUpdate u(&state_);
+  const auto [it, inserted] = state_.vcp_features.try_emplace(code, real_value);
+  if (!inserted && it->second == real_value) return real_value;
+  it->second = real_value;
+  ++state_.vcp_generation;
+  u.Changed();
+  return real_value;
+}
+// Outputs are named as the compositor names them, whether or not they're
+// connected yet, and keep these targets until the next `set` or `fade`.
+std::map<std::string, int64_t> DDCLight::setmany(
+    const std::map<std::string, int64_t>& percentages) {
+  TraceScope trace("DDCLight::setmany");
+  trace.Arg("outputs", percentages.size());
+  std::map<std::string, int64_t> ret;
+  StateUpdate u(&state_);
+  for (const auto& [output, percentage] : percentages) {
+    const int real_percentage =
+        std::clamp(percentage, int64_t{0}, int64_t{100});
+    state_.output_levels.insert_or_assign(output,
+                                          LevelFromPercent(real_percentage));
+    ret.emplace_hint(ret.end(), output, real_percentage);
+    u.TargetChanged();
+  }
+  return ret;
+}
+// Answered from `AnswerSetWaits` once every output with a control has
+// applied the new percentage, or at the deadline with however far each got.
+// Outputs are woken as for `set`, and wake the reactor in turn as they apply
+// it, so replies aren't held up by polling.
+void DDCLight::setwait(sdbus::Result<int64_t, SetWaitResults>&& result,
+                       const int64_t& percentage, const int64_t& timeout_ms) {
+  // Clients time calls out after 25s by default.
+  constexpr int64_t kMaxTimeoutMs = 20000;
+  const int64_t new_level = setlevel(
+      LevelFromPercent(std::clamp(percentage, int64_t{0}, int64_t{100})));
+  const absl::Time now = absl::Now();
+  set_waits_.push_back(
+      {.result = std::move(result),
+       .level = static_cast<int>(new_level),
+       .start = now,
+       .deadline = now + absl::Milliseconds(std::clamp(
+                             timeout_ms, int64_t{0}, kMaxTimeoutMs))});
+  set_waiting_.store(true, std::memory_order_relaxed);
+}
+
+// Returns when to look again, if anything's still waiting.
+absl::Time DDCLight::AnswerSetWaits() {
+  if (set_waits_.empty()) return absl::InfiniteFuture();
+  const absl::Time now = absl::Now();
+  absl::Time due = absl::InfiniteFuture();
+  for (auto it = set_waits_.begin(); it != set_waits_.end();) {
+    const double elapsed_ms = absl::ToDoubleMilliseconds(now - it->start);
+    const bool expired = now >= it->deadline;
+    bool done = true;
+    for (const auto& output : outputs_) {
+      const Output::Info info = output.output().info();
+      if (info.backend.empty() || it->results.count(info.name)) continue;
+      const bool applied = info.applied == it->level;
+      if (applied || expired)
+        it->results.emplace(
+            info.name,
+            sdbus::Struct<bool, int64_t, double>(
+                applied, info.applied ? PercentFromLevel(*info.applied) : -1,
+                elapsed_ms));
+      done = done && applied;
+    }
+    if (!done && !expired) {
+      due = std::min(due, it->deadline);
+      ++it;
+      continue;
+    }
+    it->result.returnResults(PercentFromLevel(it->level), it->results);
+    it = set_waits_.erase(it);
+  }
+  set_waiting_.store(!set_waits_.empty(), std::memory_order_relaxed);
+  return due;
+}
+
+// Sections are "output <name>" for each output, with its control's traffic as
+// well as how it kept up with targets, "bus <link>" for each DDC/CI link,
+// with the traffic of every control on it, "watch", with how many `watch`
+// signals went out and how many changes were folded into later ones, and
+// "lockstep", with how far apart outputs' writes for each change landed.
+std::map<std::string, std::map<std::string, double>> DDCLight::stats() {
+  std::map<std::string, std::map<std::string, double>> ret;
+  for (const auto& output : outputs_) {
+    std::string name = output.output().info().name;
+    if (name.empty()) name = absl::StrCat(output.wayland_name());
+    output.output().ReportStats(&ret[absl::StrCat("output ", name)]);
+  }
+  for (const auto& [device, pacer] : ddc_pacers_.All())
+    pacer->stats().Report(&ret[absl::StrCat("bus ", device)]);
+  ret["watch"] = {{"signals", static_cast<double>(watch_.emitted())},
+                  {"suppressed", static_cast<double>(watch_.suppressed())}};
+  ret["hotplug"] = {{"events", static_cast<double>(hotplug_events_)},
+                    {"reprobes", static_cast<double>(reprobes_)},
+                    {"device_probes", static_cast<double>(device_probes_)}};
+  lockstep_.Report(&ret["lockstep"]);
+  return ret;
 }
 
 }  // namespace jjaro
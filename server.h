@@ -2,40 +2,111 @@
 #define JJARO_SERVER_H_ 1
 
 #include <absl/base/thread_annotations.h>
+#include <absl/strings/string_view.h>
 #include <absl/synchronization/mutex.h>
+#include <absl/time/time.h>
 #include <sdbus-c++/AdaptorInterfaces.h>
 #include <sdbus-c++/IConnection.h>
 #include <sdbus-c++/Types.h>
 
+#include <atomic>
 #include <cstdint>
 #include <list>
+#include <map>
+#include <memory>
+#include <string>
 
+#include "ddc-pacer.h"
 #include "ddclight-server-glue.h"
 #include "enumerate.h"
-#include "output.h"
+#include "hotplug.h"
+#include "line-socket.h"
+#include "lockstep.h"
+#include "output-object.h"
+#include "probe-cache.h"
+#include "prober.h"
+#include "reactor.h"
 #include "state.h"
+#include "watch-notifier.h"
 
 namespace jjaro {
 
 class DDCLight final
     : public sdbus::AdaptorInterfaces<org::jjaro::DDCLight_adaptor> {
  public:
-  DDCLight(sdbus::IConnection& connection, sdbus::ObjectPath objectPath);
+  // Serves `connection` and Wayland from `reactor`, which must outlive this.
+  DDCLight(sdbus::IConnection& connection, sdbus::ObjectPath objectPath,
+           Reactor* reactor);
   ~DDCLight();
 
  private:
+  absl::Time PrepareBus();
+  void PassOnDrifts();
   void AddOutput(uint32_t name, uint32_t version);
   void RemoveOutput(uint32_t name);
+  void HandleUevent(const Uevent& event);
+  // Has `watch_` tell D-Bus and socket watchers about `level`, to the nearest
+  // percent.
+  void NotifyWatchers(int level);
+  std::string HandleRequest(absl::string_view request);
   int64_t get() override;
   int64_t poke() override;
   int64_t set(const int64_t& percentage) override;
   int64_t increment(const int64_t& percentage) override;
   int64_t decrement(const int64_t& percentage) override;
+  int64_t fade(const int64_t& percentage, const int64_t& duration_ms) override;
+  int64_t getlevel() override;
+  int64_t setlevel(const int64_t& level) override;
+  int64_t fadelevel(const int64_t& level, const int64_t& duration_ms) override;
+  int64_t getvcp(const int64_t& code) override;
+  int64_t setvcp(const int64_t& code, const int64_t& value) override;
+  std::map<std::string, int64_t> setmany(
+      const std::map<std::string, int64_t>& percentages) override;
+  std::map<std::string, std::map<std::string, double>> stats() override;
+  // By output name: whether it got there, the percentage it was at, and the
+  // milliseconds until then or until giving up.
+  using SetWaitResults =
+      std::map<std::string, sdbus::Struct<bool, int64_t, double>>;
+  void setwait(sdbus::Result<int64_t, SetWaitResults>&& result,
+               const int64_t& percentage, const int64_t& timeout_ms) override;
+  absl::Time AnswerSetWaits();
 
+  sdbus::IConnection& connection_;
+  Reactor* reactor_;
+  const absl::Duration reconcile_interval_;
+  int bus_prepare_ = -1;
+  int bus_fd_ = -1, bus_event_fd_ = -1;
   State state_;
+  ProbeCache probe_cache_;
+  DDCPacers ddc_pacers_;
+  Lockstep lockstep_;
   absl::Mutex lock_;
-  std::list<Output> outputs_ ABSL_GUARDED_BY(lock_);
+  std::list<OutputObject> outputs_ ABSL_GUARDED_BY(lock_);
   Enumerator enumerator_;
+  WatchNotifier watch_;
+  // A `setwait` call not yet answered.
+  struct SetWait {
+    sdbus::Result<int64_t, SetWaitResults> result;
+    int level;
+    absl::Time start, deadline;
+    SetWaitResults results;
+  };
+  std::list<SetWait> set_waits_;
+  // Whether `set_waits_` has anything in it, for output threads to tell
+  // whether anyone's waiting on them.
+  std::atomic<bool> set_waiting_ = false;
+  std::unique_ptr<LineSocketServer> socket_;
+  std::unique_ptr<HotplugMonitor> hotplug_;
+  // Events `hotplug_` passed on, and the full and single-bus probes they set
+  // off.
+  uint64_t hotplug_events_ = 0, reprobes_ = 0, device_probes_ = 0;
+  absl::Mutex drift_lock_;
+  // Levels outputs found themselves at, by name, as their threads hand them
+  // over for `PassOnDrifts`.
+  std::map<std::string, int> drifts_ ABSL_GUARDED_BY(drift_lock_);
+  // Last, so that removed outputs it's still tearing down can call back into
+  // everything above until it's gone.
+  Prober prober_;
 };
 
 }  // namespace jjaro
@@ -0,0 +1,135 @@
+// Requests over the daemon's Unix socket, served from a `Reactor` in a forked
+// child as the daemon serves them.  Besides round-trip time, each benchmark
+// reports the server's CPU time per request, from the child's rusage.
+#include <absl/strings/str_cat.h>
+#include <absl/strings/string_view.h>
+#include <benchmark/benchmark.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include "line-socket.h"
+#include "reactor.h"
+
+namespace jjaro {
+namespace {
+double ChildrenCPUSeconds() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_CHILDREN, &usage) != 0) return 0;
+  return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+// A server in a child process that answers every request with a percentage,
+// as the daemon does, until it's destroyed.
+class ForkedServer {
+ public:
+  ForkedServer() {
+    const char *const tmpdir = getenv("TMPDIR");
+    path_ = absl::StrCat(tmpdir && *tmpdir ? tmpdir : "/tmp",
+                         "/ddclight-bench-", getpid(), ".sock");
+    int ready[2];
+    if (pipe(ready) != 0) return;
+    pid_ = fork();
+    if (pid_ == 0) {
+      close(ready[0]);
+      auto reactor = Reactor::Create();
+      if (!reactor.ok()) _exit(EXIT_FAILURE);
+      int64_t percentage = 50;
+      auto server = LineSocketServer::Listen(
+          &*reactor, path_, [&percentage](absl::string_view request) {
+            percentage = (percentage + 1) % 101;
+            return absl::StrCat(percentage);
+          });
+      if (!server.ok()) _exit(EXIT_FAILURE);
+      if (write(ready[1], "", 1) != 1) _exit(EXIT_FAILURE);
+      (void)reactor->Run();
+      _exit(EXIT_FAILURE);
+    }
+    close(ready[1]);
+    char c;
+    ok_ = pid_ > 0 && read(ready[0], &c, 1) == 1;
+    close(ready[0]);
+  }
+  ForkedServer(const ForkedServer &) = delete;
+  ForkedServer &operator=(const ForkedServer &) = delete;
+  // Returns the CPU time the server used.
+  double Stop() {
+    if (pid_ <= 0) return 0;
+    const double before = ChildrenCPUSeconds();
+    kill(pid_, SIGKILL);
+    int status;
+    waitpid(pid_, &status, 0);
+    pid_ = -1;
+    unlink(path_.c_str());
+    return ChildrenCPUSeconds() - before;
+  }
+  ~ForkedServer() { Stop(); }
+
+  bool ok() const { return ok_; }
+  const std::string &path() const { return path_; }
+
+ private:
+  std::string path_;
+  pid_t pid_ = -1;
+  bool ok_ = false;
+};
+
+void ReportServerCPU(benchmark::State &state, ForkedServer *server) {
+  state.counters["server_cpu_us"] = benchmark::Counter(
+      server->Stop() * 1e6, benchmark::Counter::kAvgIterations);
+}
+
+// Requests over a connection that's kept open, as `watch` keeps one.
+void BM_SocketCall(benchmark::State &state) {
+  ForkedServer server;
+  if (!server.ok()) {
+    state.SkipWithError("couldn't start server");
+    return;
+  }
+  auto client = LineSocketClient::Connect(server.path());
+  if (!client.ok()) {
+    state.SkipWithError(client.status().ToString().c_str());
+    return;
+  }
+  for (auto _ : state) {
+    const auto reply = client->Call("increment 1");
+    if (!reply.ok()) {
+      state.SkipWithError(reply.status().ToString().c_str());
+      return;
+    }
+  }
+  ReportServerCPU(state, &server);
+}
+BENCHMARK(BM_SocketCall);
+
+// A connection per request, as each `ddclight set` makes.
+void BM_SocketConnectAndCall(benchmark::State &state) {
+  ForkedServer server;
+  if (!server.ok()) {
+    state.SkipWithError("couldn't start server");
+    return;
+  }
+  for (auto _ : state) {
+    auto client = LineSocketClient::Connect(server.path());
+    if (!client.ok()) {
+      state.SkipWithError(client.status().ToString().c_str());
+      return;
+    }
+    const auto reply = client->Call("increment 1");
+    if (!reply.ok()) {
+      state.SkipWithError(reply.status().ToString().c_str());
+      return;
+    }
+  }
+  ReportServerCPU(state, &server);
+}
+BENCHMARK(BM_SocketConnectAndCall);
+}  // namespace
+}  // namespace jjaro
@@ -0,0 +1,140 @@
+// What a target change costs the D-Bus handler making it, with `outputs`
+// threads waiting on `State` for it.  The handlers themselves need a bus, so
+// these make the same changes to `State` that `set` and `increment` do.  Waking outputs through their own
+// `Waker`s, each passing the wake along, should keep this flat as outputs are
+// added; waiting on `State::lock` itself, as outputs used to, has every unlock
+// evaluate every waiter's condition.
+#include <absl/strings/str_cat.h>
+#include <absl/synchronization/mutex.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "state.h"
+#include "waker.h"
+
+namespace jjaro {
+namespace {
+constexpr auto kSettleTime = absl::Microseconds(100);
+
+// Follows `desired_level` as `Output` does, minus the control.
+void FollowWithWaker(State *state, const std::atomic<bool> *stop,
+                     std::atomic<int> *seen) {
+  Waker waker;
+  state->Subscribe(&waker);
+  uint64_t seen_generation = ~uint64_t{0};
+  uint64_t relayed_generation = 0;
+  int current = -1;
+  while (!stop->load(std::memory_order_relaxed)) {
+    const uint32_t seq = waker.seq();
+    const uint64_t generation =
+        state->generation.load(std::memory_order_acquire);
+    if (generation != seen_generation) {
+      absl::MutexLock l(&state->lock);
+      current = state->desired_level.value_or(50);
+      seen_generation = generation;
+      seen->store(current, std::memory_order_release);
+      continue;
+    }
+    waker.WaitUntil(seq, absl::InfiniteFuture());
+    if (const uint64_t generation = state->generation.load();
+        generation != relayed_generation) {
+      relayed_generation = generation;
+      state->WakeAfter(&waker);
+    }
+  }
+  state->Unsubscribe(&waker);
+}
+
+void FollowWithAwait(State *state, const std::atomic<bool> *stop,
+                     std::atomic<int> *seen) {
+  int current = -1;
+  absl::MutexLock l(&state->lock);
+  while (true) {
+    auto cond = [state, stop, current] {
+      return stop->load(std::memory_order_relaxed) ||
+             state->desired_level.value_or(50) != current;
+    };
+    state->lock.Await(absl::Condition(&cond));
+    if (stop->load(std::memory_order_relaxed)) return;
+    current = state->desired_level.value_or(50);
+    seen->store(current, std::memory_order_release);
+  }
+}
+
+// With `overrides`, every output also has a target of its own, as after a
+// `setmany`, for changes to shift along as `increment` does.
+void RunLatencyBenchmark(benchmark::State &bm, bool waker, int outputs,
+                         bool overrides) {
+  State state;
+  {
+    absl::MutexLock l(&state.lock);
+    state.desired_level = 0;
+    if (overrides)
+      for (int i = 0; i < outputs; ++i)
+        state.output_levels.emplace(absl::StrCat("output-", i), 0);
+  }
+  std::atomic<bool> stop = false;
+  std::vector<std::atomic<int>> seen(outputs);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < outputs; ++i) {
+    seen[i] = -1;
+    threads.emplace_back(waker ? FollowWithWaker : FollowWithAwait, &state,
+                         &stop, &seen[i]);
+  }
+  int level = 0;
+  for (auto _ : bm) {
+    // Like key presses, each change comes once every output has caught up
+    // with the last and gone back to sleep.
+    for (const auto &s : seen)
+      while (s.load(std::memory_order_acquire) != level)
+        std::this_thread::yield();
+    absl::SleepFor(kSettleTime);
+    level = (level + 1) % 101;
+    const absl::Time start = absl::Now();
+    if (waker) {
+      StateUpdate u(&state);
+      state.desired_level = level;
+      for (auto &[output, output_level] : state.output_levels)
+        output_level = level;
+      u.TargetChanged();
+    } else {
+      absl::MutexLock l(&state.lock);
+      state.desired_level = level;
+    }
+    bm.SetIterationTime(absl::ToDoubleSeconds(absl::Now() - start));
+  }
+  {
+    StateUpdate u(&state);
+    stop.store(true, std::memory_order_relaxed);
+    u.Changed();
+  }
+  for (auto &thread : threads) thread.join();
+}
+
+void BM_SetLatency(benchmark::State &bm) {
+  RunLatencyBenchmark(bm, bm.range(0), bm.range(1), false);
+}
+BENCHMARK(BM_SetLatency)
+    ->ArgNames({"waker", "outputs"})
+    ->ArgsProduct({{0, 1}, {1, 4, 16, 64}})
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_IncrementLatency(benchmark::State &bm) {
+  RunLatencyBenchmark(bm, true, bm.range(0), true);
+}
+BENCHMARK(BM_IncrementLatency)
+    ->ArgName("outputs")
+    ->RangeMultiplier(4)
+    ->Range(1, 64)
+    ->UseManualTime()
+    ->Unit(benchmark::kMicrosecond);
+}  // namespace
+}  // namespace jjaro
@@ -2,13 +2,148 @@
 #define JJARO_STATE_H_ 1
 #include <absl/base/thread_annotations.h>
 #include <absl/synchronization/mutex.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
 #include <optional>
+#include <string>
+#include <vector>
+
+#include "brightness.h"
+#include "waker.h"
 
 namespace jjaro {
+// A fade from level `from` at `start` to `to` at `end`.
+struct Transition {
+  int from, to;
+  absl::Time start, end;
+};
+
+// What outputs should be doing, in brightness levels.  Changes go through
+// `StateUpdate`, which wakes subscribed outputs through their own `Waker`s
+// rather than having them wait on `lock` itself.
 struct State {
   absl::Mutex lock;
-  std::optional<int> desired_percentage ABSL_GUARDED_BY(lock);
+  std::optional<int> desired_level ABSL_GUARDED_BY(lock);
+  // Set while fading towards `desired_level`, and left to expire.
+  std::optional<Transition> transition ABSL_GUARDED_BY(lock);
+  // The latest raw value wanted for each VCP feature besides brightness.
+  // Outputs only ever send the newest, however many came in between.
+  std::map<uint8_t, uint16_t> vcp_features ABSL_GUARDED_BY(lock);
+  // Bumped on every change to `vcp_features`, for outputs to wait on.
+  uint64_t vcp_generation ABSL_GUARDED_BY(lock) = 0;
+  // Targets for single outputs, by name, which they follow instead of
+  // `desired_level` and `transition` until the next `set` or `fade`.
+  std::map<std::string, int, std::less<>> output_levels
+      ABSL_GUARDED_BY(lock);
+  // When any of the targets above last changed, and how many times they have,
+  // for outputs to tell how long they took to get there and how many targets
+  // they skipped on the way.
+  absl::Time target_changed_at ABSL_GUARDED_BY(lock) = absl::InfinitePast();
+  uint64_t target_changes ABSL_GUARDED_BY(lock) = 0;
+  // Bumped, with `lock` held, on every change to any of the above.  Outputs
+  // compare it against what they last saw before bothering with `lock`.
+  std::atomic<uint64_t> generation = 0;
+  absl::Mutex wakers_lock;
+  std::vector<Waker *> wakers ABSL_GUARDED_BY(wakers_lock);
+
+  void Subscribe(Waker *waker) {
+    absl::MutexLock l(&wakers_lock);
+    wakers.push_back(waker);
+  }
+  void Unsubscribe(Waker *waker) {
+    absl::MutexLock l(&wakers_lock);
+    wakers.erase(std::remove(wakers.begin(), wakers.end(), waker),
+                 wakers.end());
+  }
+  // Wakes subscribers in turn, starting after `after` or else from the first,
+  // up to and including the first one that was asleep.  Having that one call
+  // this in turn once it's up, for each `generation` it sees, keeps the cost
+  // of a change to one futex wake however many outputs there are.  Those that
+  // weren't asleep will look at `generation` before they next sleep anyway.
+  void WakeAfter(const Waker *after) {
+    absl::ReaderMutexLock l(&wakers_lock);
+    auto it = wakers.begin();
+    if (after) {
+      it = std::find(wakers.begin(), wakers.end(), after);
+      if (it == wakers.end()) return;
+      ++it;
+    }
+    for (; it != wakers.end(); ++it)
+      if ((*it)->Wake()) return;
+  }
+
+  // Where `output` should end up once any fade is done.
+  std::optional<int> DesiredFor(absl::string_view output) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
+    if (const auto it = output_levels.find(output);
+        it != output_levels.end())
+      return it->second;
+    return desired_level;
+  }
+
+  // Where outputs should be at `t`: partway along `transition` if it hasn't
+  // ended by then, and `desired_level` otherwise.
+  int TargetAt(absl::Time t) const ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
+    const int target = desired_level.value_or(kMaxBrightnessLevel / 2);
+    if (!transition || t >= transition->end) return target;
+    if (t <= transition->start) return transition->from;
+    const double progress =
+        absl::FDivDuration(t - transition->start,
+                           transition->end - transition->start);
+    return transition->from +
+           static_cast<int>((transition->to - transition->from) * progress);
+  }
+  // Where `output` in particular should be at `t`.
+  int TargetAt(absl::Time t, absl::string_view output) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(lock) {
+    if (const auto it = output_levels.find(output);
+        it != output_levels.end())
+      return it->second;
+    return TargetAt(t);
+  }
+};
+
+// Holds `State::lock` for making changes, and once it's released, wakes every
+// subscriber if any were made.
+class ABSL_SCOPED_LOCKABLE StateUpdate {
+ public:
+  explicit StateUpdate(State *state) ABSL_EXCLUSIVE_LOCK_FUNCTION(state->lock)
+      : state_(state) {
+    state_->lock.Lock();
+  }
+  StateUpdate(const StateUpdate &) = delete;
+  StateUpdate &operator=(const StateUpdate &) = delete;
+  ~StateUpdate() ABSL_UNLOCK_FUNCTION() {
+    state_->lock.Unlock();
+    if (changed_) state_->WakeAfter(nullptr);
+  }
+
+  void Changed() {
+    if (!changed_)
+      state_->generation.fetch_add(1, std::memory_order_release);
+    changed_ = true;
+  }
+  // As `Changed`, for changes to where outputs should be headed.
+  void TargetChanged() {
+    if (!target_changed_) {
+      state_->target_changed_at = absl::Now();
+      ++state_->target_changes;
+    }
+    target_changed_ = true;
+    Changed();
+  }
+
+ private:
+  State *const state_;
+  bool changed_ = false;
+  bool target_changed_ = false;
 };
 }  // namespace jjaro
 #endif  // JJARO_STATE_H_
@@ -0,0 +1,89 @@
+#include "stats.h"
+
+#include <absl/numeric/bits.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+namespace jjaro {
+namespace {
+constexpr auto kRelaxed = std::memory_order_relaxed;
+
+// The upper bound of bucket `i`, in milliseconds.
+double BucketLimitMs(int i) {
+  return static_cast<double>(uint64_t{1} << i) / 1000;
+}
+}  // namespace
+
+void LatencyHistogram::Record(absl::Duration d) {
+  const uint64_t us = std::max<int64_t>(absl::ToInt64Microseconds(d), 0);
+  const int bucket = std::min<int>(absl::bit_width(us), kBuckets - 1);
+  buckets_[bucket].fetch_add(1, kRelaxed);
+  count_.fetch_add(1, kRelaxed);
+  total_us_.fetch_add(us, kRelaxed);
+  uint64_t max = max_us_.load(kRelaxed);
+  while (us > max && !max_us_.compare_exchange_weak(max, us, kRelaxed)) {
+  }
+}
+
+void LatencyHistogram::Report(absl::string_view name, StatsReport *out) const {
+  std::array<uint64_t, kBuckets> buckets;
+  uint64_t count = 0;
+  for (int i = 0; i < kBuckets; ++i)
+    count += buckets[i] = buckets_[i].load(kRelaxed);
+  (*out)[absl::StrCat(name, "_count")] = count;
+  if (!count) return;
+  (*out)[absl::StrCat(name, "_mean_ms")] =
+      static_cast<double>(total_us_.load(kRelaxed)) / count / 1000;
+  (*out)[absl::StrCat(name, "_max_ms")] =
+      static_cast<double>(max_us_.load(kRelaxed)) / 1000;
+  for (const auto &[percentile, label] :
+       {std::pair{50, "p50"}, std::pair{90, "p90"}, std::pair{99, "p99"}}) {
+    // The smallest bucket with at least this share of samples at or below it.
+    const uint64_t rank = (count * percentile + 99) / 100;
+    uint64_t seen = 0;
+    int i = 0;
+    while (i < kBuckets - 1 && (seen += buckets[i]) < rank) ++i;
+    (*out)[absl::StrCat(name, "_", label, "_ms")] = BucketLimitMs(i);
+  }
+}
+
+void TransportStats::RecordWrite(absl::Duration took, bool acked) {
+  write_time.Record(took);
+  if (!acked) naks.fetch_add(1, kRelaxed);
+}
+void TransportStats::RecordRead(absl::Duration took, bool acked) {
+  read_time.Record(took);
+  if (!acked) naks.fetch_add(1, kRelaxed);
+}
+void TransportStats::RecordTransaction(int retries) {
+  transactions.fetch_add(1, kRelaxed);
+  this->retries.fetch_add(retries, kRelaxed);
+}
+void TransportStats::Report(StatsReport *out) const {
+  write_time.Report("write", out);
+  read_time.Report("read", out);
+  (*out)["transactions"] = transactions.load(kRelaxed);
+  (*out)["retries"] = retries.load(kRelaxed);
+  (*out)["naks"] = naks.load(kRelaxed);
+  (*out)["checksum_failures"] = checksum_failures.load(kRelaxed);
+  if (const int64_t us = reply_delay_us.load(kRelaxed); us >= 0)
+    (*out)["reply_delay_ms"] = static_cast<double>(us) / 1000;
+}
+
+void OutputStats::Report(StatsReport *out) const {
+  target_to_write.Report("target_to_write", out);
+  (*out)["writes"] = writes.load(kRelaxed);
+  (*out)["failures"] = failures.load(kRelaxed);
+  (*out)["coalesced"] = coalesced.load(kRelaxed);
+  (*out)["reconcile_reads"] = reconcile_reads.load(kRelaxed);
+  (*out)["drifts"] = drifts.load(kRelaxed);
+  (*out)["reported_changes"] = reported_changes.load(kRelaxed);
+}
+}  // namespace jjaro
@@ -0,0 +1,73 @@
+#ifndef JJARO_STATS_H_
+#define JJARO_STATS_H_ 1
+#include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace jjaro {
+// Named values, as the `stats` D-Bus method hands them out.
+using StatsReport = std::map<std::string, double>;
+
+// Durations in power-of-two microsecond buckets.  Recording is a few relaxed
+// atomic adds, so any thread can do it on every transaction.
+class LatencyHistogram {
+ public:
+  // Bucket 0 is under 1us, and bucket `i` is [2^(i-1), 2^i)us, with the last
+  // taking everything from about 4s up.
+  static constexpr int kBuckets = 24;
+
+  void Record(absl::Duration d);
+  // Adds `<name>_count`, and the mean, 50th, 90th and 99th percentiles and
+  // max in `<name>_<stat>_ms`.  Percentiles are bucket upper bounds.
+  void Report(absl::string_view name, StatsReport *out) const;
+
+ private:
+  std::array<std::atomic<uint64_t>, kBuckets> buckets_{};
+  std::atomic<uint64_t> count_ = 0;
+  std::atomic<uint64_t> total_us_ = 0;
+  std::atomic<uint64_t> max_us_ = 0;
+};
+
+// Traffic to one control, or over one bus.
+struct TransportStats {
+  LatencyHistogram write_time, read_time;
+  std::atomic<uint64_t> transactions = 0;
+  // Writes and reads that had to be made again within a transaction.
+  std::atomic<uint64_t> retries = 0;
+  // Writes and reads the device didn't acknowledge.
+  std::atomic<uint64_t> naks = 0;
+  std::atomic<uint64_t> checksum_failures = 0;
+  // How long a DDC/CI control currently waits for a Get VCP reply, as it's
+  // learned the monitor's pace, or negative for anything else.
+  std::atomic<int64_t> reply_delay_us = -1;
+
+  void RecordWrite(absl::Duration took, bool acked);
+  void RecordRead(absl::Duration took, bool acked);
+  void RecordTransaction(int retries);
+  void Report(StatsReport *out) const;
+};
+
+// How one output keeps up with its targets.
+struct OutputStats {
+  // From the change that set a target to the write that reached it.
+  LatencyHistogram target_to_write;
+  std::atomic<uint64_t> writes = 0;
+  std::atomic<uint64_t> failures = 0;
+  // Targets that were replaced before this output got around to them.
+  std::atomic<uint64_t> coalesced = 0;
+  // Brightness read back between targets, and how often it had been changed
+  // by something other than this daemon.
+  std::atomic<uint64_t> reconcile_reads = 0;
+  std::atomic<uint64_t> drifts = 0;
+  // Changes the control reported, each of which costs a read back.
+  std::atomic<uint64_t> reported_changes = 0;
+
+  void Report(StatsReport *out) const;
+};
+}  // namespace jjaro
+#endif  // JJARO_STATS_H_
@@ -0,0 +1,235 @@
+#include "sysfs-fixture.h"
+
+#include <absl/status/status.h>
+#include <absl/status/statusor.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/string_view.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+
+#include "misc.h"
+
+namespace jjaro {
+namespace {
+// Real connector and PCI device directories are full of attributes the probe
+// has to read past, so pad ours out to something like the same size.
+constexpr absl::string_view kConnectorAttrs[] = {
+    "dpms", "enabled", "modes", "status", "uevent", "link_status"};
+constexpr absl::string_view kPCIAttrs[] = {
+    "class",     "config",        "consistent_dma_mask_bits",
+    "device",    "enable",        "irq",
+    "local_cpus", "modalias",     "numa_node",
+    "resource",  "revision",      "subsystem_device",
+    "subsystem_vendor", "uevent", "vendor"};
+// i2c-dev's character device major.
+constexpr int kI2CMajor = 89;
+
+absl::Status MakeDir(const std::string &path) {
+  if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST)
+    return absl::ErrnoToStatus(errno, absl::StrCat("mkdir failed for ", path));
+  return absl::OkStatus();
+}
+
+absl::Status MakeDirs(const std::string &root, absl::string_view rel) {
+  std::string path = root;
+  for (size_t slash = 0; slash != rel.npos;) {
+    const size_t next = rel.find('/', slash + 1);
+    absl::StrAppend(&path, rel.substr(slash, next - slash));
+    if (auto ms = MakeDir(path); !ms.ok()) return ms;
+    slash = next;
+  }
+  return absl::OkStatus();
+}
+
+absl::Status MakeLink(const std::string &target, const std::string &path) {
+  if (symlink(target.c_str(), path.c_str()) != 0)
+    return absl::ErrnoToStatus(errno,
+                               absl::StrCat("symlink failed for ", path));
+  return absl::OkStatus();
+}
+
+absl::Status MakeFile(const std::string &path, absl::string_view contents) {
+  auto fd = Open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (!fd.ok()) return fd.status();
+  while (!contents.empty()) {
+    const ssize_t wret = write(fd->get(), contents.data(), contents.size());
+    if (wret < 0 && errno == EINTR) continue;
+    if (wret < 0)
+      return absl::ErrnoToStatus(errno, absl::StrCat("write failed for ", path));
+    contents.remove_prefix(wret);
+  }
+  return fd->Close();
+}
+
+// A minimal base block: the fixed header, a serial number to tell outputs
+// apart, and a valid checksum.
+std::string MakeEDID(uint32_t serial) {
+  std::string edid(128, '\0');
+  for (size_t i = 1; i < 7; i++) edid[i] = '\xff';
+  for (size_t i = 0; i < 4; i++) edid[12 + i] = serial >> (8 * i);
+  uint8_t sum = 0;
+  for (const char c : edid) sum += c;
+  edid[127] = -sum;
+  return edid;
+}
+
+// Lays out one `i2c-*` adapter under the card's PCI device, numbered as
+// i2c-dev would number it but with no node in /dev.
+absl::Status MakeBus(const std::string &root, const std::string &pci_dir,
+                     int bus_num, absl::string_view name) {
+  const std::string bus = absl::StrCat("i2c-", bus_num);
+  const std::string bus_dir = absl::StrCat(pci_dir, "/", bus);
+  if (auto ms = MakeDirs(root, absl::StrCat(bus_dir.substr(root.size()),
+                                            "/i2c-dev/", bus));
+      !ms.ok())
+    return ms;
+  if (auto ms = MakeFile(absl::StrCat(bus_dir, "/name"), name); !ms.ok())
+    return ms;
+  if (auto ms = MakeFile(absl::StrCat(bus_dir, "/i2c-dev/", bus, "/dev"),
+                         absl::StrCat(kI2CMajor, ":", bus_num, "\n"));
+      !ms.ok())
+    return ms;
+  return MakeLink(bus_dir, absl::StrCat(root, "/sys/bus/i2c/devices/", bus));
+}
+
+int RemoveEntry(const char *path, const struct stat *, int, struct FTW *) {
+  return remove(path);
+}
+}  // namespace
+
+absl::StatusOr<SyntheticSysfs> SyntheticSysfs::Create(
+    const SyntheticTopology &topology) {
+  const char *const tmpdir = getenv("TMPDIR");
+  std::string root =
+      absl::StrCat(tmpdir && *tmpdir ? tmpdir : "/tmp", "/ddclight-XXXXXX");
+  if (!mkdtemp(root.data()))
+    return absl::ErrnoToStatus(errno, "mkdtemp failed");
+  SyntheticSysfs sysfs(std::move(root));
+  const std::string &r = sysfs.root_;
+  for (const absl::string_view dir :
+       {"/dev", "/sys/class/drm", "/sys/class/backlight",
+        "/sys/bus/i2c/devices"})
+    if (auto ms = MakeDirs(r, dir); !ms.ok()) return ms;
+  int next_bus = 0, next_connector = 1;
+  for (int card = 0; card < topology.cards; card++) {
+    const std::string pci_rel =
+        absl::StrCat("/sys/devices/pci0000:00/0000:00:", absl::Hex(card + 2),
+                     ".0");
+    const std::string pci_dir = absl::StrCat(r, pci_rel);
+    const std::string card_name = absl::StrCat("card", card);
+    const std::string card_dir = absl::StrCat(pci_dir, "/drm/", card_name);
+    if (auto ms = MakeDirs(r, absl::StrCat(pci_rel, "/drm/", card_name));
+        !ms.ok())
+      return ms;
+    for (const absl::string_view attr : kPCIAttrs)
+      if (auto ms = MakeFile(absl::StrCat(pci_dir, "/", attr), "");
+          !ms.ok())
+        return ms;
+    if (auto ms = MakeLink(pci_dir, absl::StrCat(card_dir, "/device"));
+        !ms.ok())
+      return ms;
+    const auto add_connector =
+        [&](absl::string_view type) -> absl::StatusOr<std::string> {
+      const std::string output = absl::StrCat(type, "-", next_connector);
+      const std::string connector_dir =
+          absl::StrCat(card_dir, "/", card_name, "-", output);
+      if (auto ms = MakeDir(connector_dir); !ms.ok()) return ms;
+      for (const absl::string_view attr : kConnectorAttrs)
+        if (auto ms = MakeFile(absl::StrCat(connector_dir, "/", attr), "");
+            !ms.ok())
+          return ms;
+      if (auto ms = MakeLink(card_dir, absl::StrCat(connector_dir, "/device"));
+          !ms.ok())
+        return ms;
+      std::string edid = MakeEDID(next_connector);
+      if (auto ms = MakeFile(absl::StrCat(connector_dir, "/edid"), edid);
+          !ms.ok())
+        return ms;
+      if (auto ms = MakeLink(connector_dir,
+                             absl::StrCat(r, "/sys/class/drm/", card_name, "-",
+                                          output));
+          !ms.ok())
+        return ms;
+      sysfs.outputs_.push_back(output);
+      sysfs.edids_.push_back(std::move(edid));
+      next_connector++;
+      return connector_dir;
+    };
+    for (int i = 0; i < topology.backlights; i++) {
+      const auto connector_dir = add_connector("eDP");
+      if (!connector_dir.ok()) return connector_dir.status();
+      const std::string device =
+          absl::StrCat("backlight", sysfs.outputs_.size());
+      const std::string device_dir = absl::StrCat(*connector_dir, "/", device);
+      if (auto ms = MakeDir(device_dir); !ms.ok()) return ms;
+      if (auto ms = MakeLink(absl::StrCat(r, "/sys/class/backlight"),
+                             absl::StrCat(device_dir, "/subsystem"));
+          !ms.ok())
+        return ms;
+      for (const auto &[attr, value] :
+           {std::pair<absl::string_view, absl::string_view>{"max_brightness",
+                                                            "1000\n"},
+            {"brightness", "500\n"},
+            {"actual_brightness", "500\n"}})
+        if (auto ms = MakeFile(absl::StrCat(device_dir, "/", attr), value);
+            !ms.ok())
+          return ms;
+      if (auto ms = MakeLink(device_dir,
+                             absl::StrCat(r, "/sys/class/backlight/", device));
+          !ms.ok())
+        return ms;
+      sysfs.buses_.emplace_back();
+    }
+    for (int i = 0; i < topology.ddc_links; i++) {
+      const auto connector_dir = add_connector("HDMI-A");
+      if (!connector_dir.ok()) return connector_dir.status();
+      const std::string bus = absl::StrCat("i2c-", next_bus);
+      if (auto ms = MakeBus(r, pci_dir, next_bus++, "AUX\n"); !ms.ok())
+        return ms;
+      if (auto ms = MakeLink(absl::StrCat(pci_dir, "/", bus),
+                             absl::StrCat(*connector_dir, "/ddc"));
+          !ms.ok())
+        return ms;
+      sysfs.buses_.push_back(bus);
+    }
+    for (int i = 0; i < topology.dpmst + topology.stray_dpmst; i++) {
+      const std::string bus = absl::StrCat("i2c-", next_bus);
+      if (auto ms = MakeBus(r, pci_dir, next_bus++, "DPMST\n"); !ms.ok())
+        return ms;
+      if (i >= topology.dpmst) {
+        sysfs.stray_buses_.push_back(bus);
+        continue;
+      }
+      if (auto connector_dir = add_connector("DP"); !connector_dir.ok())
+        return connector_dir.status();
+      sysfs.buses_.push_back(bus);
+    }
+  }
+  return sysfs;
+}
+
+SyntheticSysfs::SyntheticSysfs(SyntheticSysfs &&that)
+    : root_(std::move(that.root_)),
+      outputs_(std::move(that.outputs_)),
+      buses_(std::move(that.buses_)),
+      edids_(std::move(that.edids_)),
+      stray_buses_(std::move(that.stray_buses_)) {
+  that.root_.clear();
+}
+
+SyntheticSysfs::~SyntheticSysfs() {
+  if (root_.empty()) return;
+  (void)nftw(root_.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+}  // namespace jjaro
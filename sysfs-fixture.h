@@ -0,0 +1,56 @@
+#ifndef JJARO_SYSFS_FIXTURE_H_
+#define JJARO_SYSFS_FIXTURE_H_ 1
+#include <absl/status/statusor.h>
+
+#include <string>
+#include <vector>
+
+namespace jjaro {
+// The shape of a synthetic tree.  Counts other than `cards` are per card.
+struct SyntheticTopology {
+  int cards = 1;
+  // eDP connectors with a backlight device.
+  int backlights = 0;
+  // HDMI connectors with a `ddc` link to their own bus.
+  int ddc_links = 0;
+  // DP MST connectors, each with a DPMST bus that's only findable by EDID.
+  int dpmst = 0;
+  // DPMST buses that don't belong to any connector.
+  int stray_dpmst = 0;
+};
+
+// Builds a throwaway sysfs and devfs tree under a temporary directory, shaped
+// closely enough like the real thing for `Control::Probe` to walk it.  Pass
+// `root()` as `ProbeContext::root`.
+//
+// There are no device nodes, since making real character devices needs
+// privileges; I2C buses get distinct i2c-dev numbers in sysfs, and probing
+// needs a `ProbeContext::i2c_opener` such as `EmulatedI2CBuses` to get past
+// opening them.
+class SyntheticSysfs {
+ public:
+  static absl::StatusOr<SyntheticSysfs> Create(
+      const SyntheticTopology &topology);
+  SyntheticSysfs(SyntheticSysfs &&that);
+  SyntheticSysfs &operator=(SyntheticSysfs &&that) = delete;
+  ~SyntheticSysfs();
+
+  const std::string &root() const { return root_; }
+  // Output names as a compositor would report them, in creation order.
+  const std::vector<std::string> &outputs() const { return outputs_; }
+  // The `i2c-*` bus each output's DDC traffic would go over, or empty for
+  // backlights; parallel to `outputs()`.
+  const std::vector<std::string> &buses() const { return buses_; }
+  // The EDID each output's connector reports; parallel to `outputs()`.
+  const std::vector<std::string> &edids() const { return edids_; }
+  // DPMST buses with no connector behind them.
+  const std::vector<std::string> &stray_buses() const { return stray_buses_; }
+
+ private:
+  explicit SyntheticSysfs(std::string root) : root_(std::move(root)) {}
+
+  std::string root_;
+  std::vector<std::string> outputs_, buses_, edids_, stray_buses_;
+};
+}  // namespace jjaro
+#endif  // JJARO_SYSFS_FIXTURE_H_
@@ -0,0 +1,99 @@
+#include "trace.h"
+
+#include <absl/status/status.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
+#include <absl/strings/str_replace.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <string>
+
+namespace jjaro {
+namespace {
+std::string Escape(absl::string_view s) {
+  return absl::StrReplaceAll(s, {{"\\", "\\\\"}, {"\"", "\\\""}});
+}
+
+int64_t ThreadId() {
+  thread_local const int64_t tid = syscall(SYS_gettid);
+  return tid;
+}
+
+double Micros(absl::Time t) {
+  return absl::ToDoubleMicroseconds(t - absl::UnixEpoch());
+}
+
+// Appends one event to the trace.  With O_APPEND, each lands whole however
+// many threads are writing, and without any lock here.
+void Emit(const std::string &event) {
+  const int fd = trace_internal::fd.load(std::memory_order_relaxed);
+  if (fd < 0) return;
+  while (write(fd, event.data(), event.size()) < 0 && errno == EINTR) {
+  }
+}
+
+std::string Args(absl::string_view name, int64_t value) {
+  return absl::StrFormat("\"%s\":%d", Escape(name), value);
+}
+}  // namespace
+
+absl::Status StartTracing(const std::string &path) {
+  const int fd =
+      open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC,
+           0644);
+  if (fd < 0)
+    return absl::ErrnoToStatus(errno,
+                               absl::StrCat("couldn't open trace ", path));
+  constexpr absl::string_view kHeader = "[\n";
+  if (write(fd, kHeader.data(), kHeader.size()) < 0) {
+    const int err = errno;
+    close(fd);
+    return absl::ErrnoToStatus(err,
+                               absl::StrCat("couldn't write trace ", path));
+  }
+  if (const int old = trace_internal::fd.exchange(fd); old >= 0) close(old);
+  return absl::OkStatus();
+}
+
+void TraceThreadName(absl::string_view name) {
+  if (!Tracing()) return;
+  Emit(absl::StrFormat(
+      "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,"
+      "\"args\":{\"name\":\"%s\"}},\n",
+      getpid(), ThreadId(), Escape(name)));
+}
+
+void TraceInstant(absl::string_view name, absl::string_view arg_name,
+                  int64_t arg) {
+  if (!Tracing()) return;
+  Emit(absl::StrFormat(
+      "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+      "\"ts\":%.3f,\"args\":{%s}},\n",
+      Escape(name), getpid(), ThreadId(), Micros(absl::Now()),
+      arg_name.empty() ? "" : Args(arg_name, arg)));
+}
+
+absl::Time TraceScope::Now() { return absl::Now(); }
+
+void TraceScope::AddArg(absl::string_view name, int64_t value) {
+  absl::StrAppend(&args_, args_.empty() ? "" : ",", Args(name, value));
+}
+
+// Spans go out as complete events, which carry both ends in one record.
+void TraceScope::Finish() {
+  const absl::Time end = absl::Now();
+  Emit(absl::StrFormat(
+      "{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,"
+      "\"dur\":%.3f,\"args\":{%s}},\n",
+      Escape(name_), getpid(), ThreadId(), Micros(start_),
+      absl::ToDoubleMicroseconds(end - start_), args_));
+}
+}  // namespace jjaro
@@ -0,0 +1,64 @@
+#ifndef JJARO_TRACE_H_
+#define JJARO_TRACE_H_ 1
+#include <absl/status/status.h>
+#include <absl/strings/string_view.h>
+#include <absl/time/time.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace jjaro {
+namespace trace_internal {
+// The file events go to, or -1 while tracing is off.
+inline std::atomic<int> fd = -1;
+}  // namespace trace_internal
+
+// Starts appending Chrome trace events, as Perfetto and chrome://tracing
+// load them, to a new file at `path`.  Each event is written as it ends, so
+// the file is usable however the daemon exits; the closing bracket the format
+// allows leaving off is never written.
+absl::Status StartTracing(const std::string &path);
+
+// This is all a trace point costs while tracing is off.
+inline bool Tracing() {
+  return trace_internal::fd.load(std::memory_order_relaxed) >= 0;
+}
+
+// Names the calling thread in the trace.
+void TraceThreadName(absl::string_view name);
+// Marks a point in time on the calling thread, with `arg` shown against it.
+void TraceInstant(absl::string_view name, absl::string_view arg_name = {},
+                  int64_t arg = 0);
+
+// Records a span on the calling thread from construction until `End` or
+// destruction, whichever comes first.  `name` must outlive it.
+class TraceScope {
+ public:
+  explicit TraceScope(absl::string_view name)
+      : name_(name), start_(Tracing() ? Now() : absl::InfinitePast()) {}
+  TraceScope(const TraceScope &) = delete;
+  TraceScope &operator=(const TraceScope &) = delete;
+  ~TraceScope() { End(); }
+
+  // Adds an argument to show against the span.
+  void Arg(absl::string_view name, int64_t value) {
+    if (start_ != absl::InfinitePast()) AddArg(name, value);
+  }
+  void End() {
+    if (start_ == absl::InfinitePast()) return;
+    Finish();
+    start_ = absl::InfinitePast();
+  }
+
+ private:
+  static absl::Time Now();
+  void AddArg(absl::string_view name, int64_t value);
+  void Finish();
+
+  absl::string_view name_;
+  absl::Time start_;
+  std::string args_;
+};
+}  // namespace jjaro
+#endif  // JJARO_TRACE_H_
@@ -0,0 +1,54 @@
+#include "waker.h"
+
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+
+namespace jjaro {
+namespace {
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) &&
+                  std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain 32-bit integers");
+
+uint32_t *FutexWord(std::atomic<uint32_t> *word) {
+  return reinterpret_cast<uint32_t *>(word);
+}
+}  // namespace
+
+bool Waker::Wake() {
+  seq_.fetch_add(1, std::memory_order_seq_cst);
+  if (!waiting_.load(std::memory_order_seq_cst)) return false;
+  syscall(SYS_futex, FutexWord(&seq_), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr,
+          nullptr, 0);
+  return true;
+}
+
+bool Waker::WaitUntil(uint32_t seen, absl::Time deadline) {
+  if (deadline <= absl::Now()) return seq() != seen;
+  const struct timespec ts = absl::ToTimespec(deadline);
+  // Announcing the wait before the last look at `seq_` means `Wake` either
+  // sees us waiting or we see its increment.
+  waiting_.store(true, std::memory_order_seq_cst);
+  bool woken = true;
+  if (seq_.load(std::memory_order_seq_cst) == seen) {
+    // Absolute and on the same clock as `absl::Now`, so interruptions don't
+    // stretch the wait.
+    const long ret = syscall(
+        SYS_futex, FutexWord(&seq_),
+        FUTEX_WAIT_BITSET_PRIVATE | FUTEX_CLOCK_REALTIME, seen,
+        deadline == absl::InfiniteFuture() ? nullptr : &ts, nullptr,
+        FUTEX_BITSET_MATCH_ANY);
+    woken = ret != -1 || errno != ETIMEDOUT;
+  }
+  waiting_.store(false, std::memory_order_relaxed);
+  return woken;
+}
+}  // namespace jjaro
@@ -0,0 +1,32 @@
+#ifndef JJARO_WAKER_H_
+#define JJARO_WAKER_H_ 1
+#include <absl/time/time.h>
+
+#include <atomic>
+#include <cstdint>
+
+namespace jjaro {
+// Wakes one waiting thread, costing only atomics when that thread isn't
+// asleep.  The waiter reads `seq()`, checks whatever it's waiting on, and
+// then waits for `seq()` to move, so a wake between the check and the wait
+// isn't lost.
+class Waker {
+ public:
+  Waker() = default;
+  Waker(const Waker &) = delete;
+  Waker &operator=(const Waker &) = delete;
+
+  uint32_t seq() const { return seq_.load(std::memory_order_acquire); }
+  // Returns true if the waiter was asleep, and so has just been woken.
+  bool Wake();
+  // Waits until `seq()` is no longer `seen`, or until `deadline`.  Returns
+  // false if it timed out, and true otherwise, including on spurious wakes.
+  bool WaitUntil(uint32_t seen, absl::Time deadline);
+
+ private:
+  // Used as a futex word.
+  std::atomic<uint32_t> seq_ = 0;
+  std::atomic<bool> waiting_ = false;
+};
+}  // namespace jjaro
+#endif  // JJARO_WAKER_H_
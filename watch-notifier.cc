@@ -0,0 +1,18 @@
+#include "watch-notifier.h"
+
+#include <absl/time/clock.h>
+#include <absl/time/time.h>
+
+namespace jjaro {
+absl::Time WatchNotifier::Flush() {
+  if (!pending_) return absl::InfiniteFuture();
+  const absl::Time now = absl::Now();
+  if (now < next_) return next_;
+  const int64_t percentage = *pending_;
+  pending_.reset();
+  ++emitted_;
+  next_ = now + window_;
+  emit_(percentage);
+  return absl::InfiniteFuture();
+}
+}  // namespace jjaro
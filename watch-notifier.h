@@ -0,0 +1,47 @@
+#ifndef JJARO_WATCH_NOTIFIER_H_
+#define JJARO_WATCH_NOTIFIER_H_ 1
+#include <absl/functional/any_invocable.h>
+#include <absl/time/time.h>
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+namespace jjaro {
+// Holds back `watch` notifications so that a burst of changes, as from key
+// repeat, reaches watchers as one per `window` rather than one per change.
+// The first change after a quiet spell goes out on the next `Flush`, and the
+// last of a burst always goes out once the window's up.
+//
+// Changes are only recorded where they're made, under whatever lock that
+// holds; `emit` runs from `Flush`, once the event loop gets back around.
+// Both have to be called from the same thread.
+class WatchNotifier {
+ public:
+  using Emit = absl::AnyInvocable<void(int64_t percentage)>;
+
+  WatchNotifier(absl::Duration window, Emit emit)
+      : window_(window), emit_(std::move(emit)) {}
+
+  void Changed(int64_t percentage) {
+    if (pending_) ++suppressed_;
+    pending_ = percentage;
+  }
+  // Emits the pending change if it's due, and returns when to call this
+  // again, or `absl::InfiniteFuture()` if there's nothing pending.
+  absl::Time Flush();
+
+  uint64_t emitted() const { return emitted_; }
+  // Changes that were superseded before they could go out.
+  uint64_t suppressed() const { return suppressed_; }
+
+ private:
+  absl::Duration window_;
+  Emit emit_;
+  std::optional<int64_t> pending_;
+  // The earliest the next change may go out.
+  absl::Time next_ = absl::InfinitePast();
+  uint64_t emitted_ = 0, suppressed_ = 0;
+};
+}  // namespace jjaro
+#endif  // JJARO_WATCH_NOTIFIER_H_